@@ -3,20 +3,36 @@
  *
  * FILE STRUCTURE:
  * first line= integer representing the number of elements
- * other lines= an integer to be sorted for each line
+ * other lines= an element to be sorted for each line (an int by default, see SortElement.h)
  *
  * PROCEDURE:
  * Each node has a portion (chunk) of data
  * with "computeNumberOfBits" i compute the number of bits necessary for the processes' representation
  * with "int2bin" and "bin2int" i can covert from bin to dec and vice versa
  *
+ * Each node sorts its own chunk once, before the first iteration
+ *
+ * Every node gets the same number of elements, ceil(n/p): the missing ones are filled with SENTINEL (key KEY_MAX),
+ * which are sorted to the end of the vector and dropped when writing the output file
+ *
+ * The chunks are sorted by a full bitonic sorting network over the d bits of the smallest hypercube containing p nodes:
+ * stage k (k=0..d-1) merges sequences of 2^(k+1) chunks in k+1 iterations, so there are d(d+1)/2 iterations in total
+ * and the input can be in any order. All the stages sort in ascending order:
+ * the first iteration of stage k flips the bits k, k-1, ..., 0 all together (it compares a chunk with its mirror),
+ * then the following ones flip the bits k-1, ..., 0 one at a time.
+ * If p isn't a power of 2, the missing nodes of the hypercube are thought as full of SENTINELs:
+ * since the lower node always keeps the low part, exchanging with them would change nothing, so they're just skipped
+ *
  * During an iteration, node k computes his binary representation and consecutively the process it has to interact with
- * the node with interesting bit=0 sends data, the one with bit=1 receives data,
- * computes the sorted chunk, splits it in half and sends half of it back
+ * the two partners swap their chunks at once and both merge them (compare-split):
+ * the node with the lower rank keeps the low part, the other one keeps the high part.
+ * Actually they swap their boundary keys first, then each one sends only the elements that can cross
+ * the partner's boundary (found by binary search), and nothing at all if the chunks are already in order
  *
  * ASSUMPTION:
- *  - a node can handle 2 chunks of data in memory
- *  - number of processes is 2^d
+ *  - a node can handle 3 chunks of data in memory (its own, the partner's and the merge output)
+ *    (for inputs bigger than the memory of the nodes see ExternalSort.c)
+ *  - with PARALLEL_IO, a shared file-system: each node reads and writes its own part of the files with MPI-IO
  *
  *  NOTE:
  *  binary are represented considering char[0] as MSB,
@@ -27,85 +43,92 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+#include "LocalSort.h"
+#include "SortIO.h"
+
 #define MASTER 0
 #define inputFile "../data/input.bin"
 #define outputFile "../data/output.bin"
 
-void sort (int*, int);
+// number of random elements written in the input file (override with -DNUMBER_OF_ELEMENTS=...)
+#ifndef NUMBER_OF_ELEMENTS
+#define NUMBER_OF_ELEMENTS 10
+#endif
+
+// 1 = each node reads and writes its part of the files with MPI-IO (shared file-system)
+// 0 = the master reads and writes the files, and sends and receives the chunks (override with -DPARALLEL_IO=0)
+#ifndef PARALLEL_IO
+#define PARALLEL_IO 1
+#endif
+
+// padding element, bigger than (or equal to) any element: it always ends up at the end of the sorted vector
+// (even after the records with key KEY_MAX, see ELEMENT_LESS in SortElement.h)
+#define SENTINEL makeElement(KEY_MAX)
+
 int computeNumberOfBits(int);
+void readChunk(FILE*, Element*, int);
+Element* readPaddedChunkParallel(int, int, int*, int*);
+int outputChunkSize(int, int, int);
 void int2bin(int, int*, int);
 int bin2int(int*, int);
-void fillInputFile(char*, int);
-void fillBitonicInputFile(char*, int);
-void printVector(int*, int);
 
 int main (int argc, char** argv){
 
 	// common local variable declaration
-	int processID, numberOfProcesses, chunkSize;
-	int *chunk;
+	int processID, numberOfProcesses, chunkSize, totalNumberOfElements;
+	Element *chunk;
 
 	// init mpi environment
 	MPI_Init(&argc, &argv);
 	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
 	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
 
-	// MASTER'S WORK
-	if (processID==0) {
+	// write something in the input file
+	if (processID==MASTER){
+		fillInputFile(inputFile, NUMBER_OF_ELEMENTS);
+	}
 
-		// write something in the input file
-		fillBitonicInputFile(inputFile, 5); printf("\n");
+	// PARALLEL I/O: each node reads its own part of the input file
+	if (PARALLEL_IO){
 
-		// master's local variable declaration
-		int totalNumberOfElements, result, rest;
+		// the input file must be complete before anybody opens it
+		MPI_Barrier(MPI_COMM_WORLD);
+		chunk=readPaddedChunkParallel(processID, numberOfProcesses, &totalNumberOfElements, &chunkSize);
+
+		// test prints
+		printf ("process %d has read the vector: ", processID);
+		printVector(chunk, chunkSize);
+		printf("\n");
+	}
+
+	// MASTER'S WORK
+	else if (processID==0) {
 
-		// read the number of elements
 		FILE *inputFilePtr=fopen(inputFile, "rb");
 		if (inputFilePtr!=NULL){
 			fread(&totalNumberOfElements, sizeof(int), 1, inputFilePtr);
 
 			// compute the chunk for each process
-			// NOTE: result is the fair distribution, assuming rest = 0
-			// while numberOfElements is the number of elements actually sent
-			result=totalNumberOfElements/numberOfProcesses;
-			rest=totalNumberOfElements%numberOfProcesses;
+			// NOTE: every process gets the same chunkSize, the rest is filled with SENTINEL
+			chunkSize=(totalNumberOfElements+numberOfProcesses-1)/numberOfProcesses;
+			chunk=(Element*)malloc(sizeof(Element)*chunkSize);
 
 			int counter;
 			for (counter=1; counter<numberOfProcesses; counter++){ // for each slave
 
-				// consider the rest
-				if (rest>0)
-					chunkSize=result+1;
-				else
-					chunkSize=result;
-
-				// allocate memory for a chunk
-				chunk=(int*)malloc(sizeof(int)*chunkSize);
-
-				// read numberOfElements numbers
-				int it;
-				for (it=0; it<chunkSize; it++)
-					fread((chunk+it), sizeof(int), 1, inputFilePtr);
+				// read chunkSize numbers (or what's left of them)
+				readChunk(inputFilePtr, chunk, chunkSize);
 
 				// send data to a slave
 				MPI_Send(&chunkSize, 1, MPI_INT, counter, 0, MPI_COMM_WORLD);
-				MPI_Send(chunk, chunkSize, MPI_INT, counter, 1, MPI_COMM_WORLD);
-
-				// free the memory
-				free(chunk);
-
-				// decrease the number of "rest elements"; it'll become negative, not a problem...
-				rest--;
+				MPI_Send(chunk, chunkSize, ELEMENT_MPI_TYPE, counter, 1, MPI_COMM_WORLD);
 			}
 
-			// finally master reads his part too (rest is <=0 for sure)
-			chunkSize=result;
-			chunk=(int*)malloc(sizeof(int)*chunkSize);
-			int it;
-			for (it=0; it<chunkSize; it++)
-				fread((chunk+it), sizeof(int), 1, inputFilePtr);
+			// finally master reads his part too
+			readChunk(inputFilePtr, chunk, chunkSize);
 
 			// test print
 			printf ("master has the vector: ");
@@ -114,8 +137,13 @@ int main (int argc, char** argv){
 
 			fclose(inputFilePtr);
 		}
-		else
-			printf ("error while opening the file");
+
+		// nobody can go on without the input
+		else {
+			printf ("error while opening the file\n");
+			MPI_Abort(MPI_COMM_WORLD, 0);
+			return 0;
+		}
 	}
 
 	// BEGIN OF SLAVES' WORK (they just have to receive data from MASTER)
@@ -125,8 +153,8 @@ int main (int argc, char** argv){
 		MPI_Recv(&chunkSize, 1, MPI_INT, MASTER, 0, MPI_COMM_WORLD, NULL);
 
 		// store the chunk
-		chunk=(int*)malloc(sizeof(int)*chunkSize);
-		MPI_Recv(chunk, chunkSize, MPI_INT, MASTER, 1, MPI_COMM_WORLD, NULL);
+		chunk=(Element*)malloc(sizeof(Element)*chunkSize);
+		MPI_Recv(chunk, chunkSize, ELEMENT_MPI_TYPE, MASTER, 1, MPI_COMM_WORLD, NULL);
 
 		// test prints
 		printf ("process %d has received the vector: ", processID);
@@ -136,148 +164,200 @@ int main (int argc, char** argv){
 
 	// NOW EACH NODE HAS ITS OWN CHUNK.
 	// BEGIN OF THE COMMON PARALLEL WORK: DISTRIBUTED BITONIC SORT
-	int globalIterator, numberOfIterations=computeNumberOfBits(numberOfProcesses); // NOTE: number Of Iterations = number of bits
+	int stage, step, globalIterator=0, numberOfIterations=computeNumberOfBits(numberOfProcesses); // NOTE: number Of Iterations = number of bits
 	int binaryId[numberOfIterations];
+	double startTime, endTime;
 
-	if (numberOfIterations!=-1){
+	// everybody needs to know how many elements aren't sentinels
+	MPI_Bcast(&totalNumberOfElements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
 
-		for (globalIterator=0; globalIterator<numberOfIterations; globalIterator++){
-			int2bin(processID, binaryId, numberOfIterations);
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime=MPI_Wtime();
 
-			// SENDER PART - if it's a "sender process"
-			if (binaryId[globalIterator]==0){
-				binaryId[globalIterator]=1; // compute which will be the receiver and send it data
-				MPI_Send(&chunkSize, 1, MPI_INT, bin2int(binaryId, numberOfIterations), globalIterator+2, MPI_COMM_WORLD);
-				MPI_Send(chunk, chunkSize, MPI_INT, bin2int(binaryId, numberOfIterations), globalIterator+2+numberOfIterations, MPI_COMM_WORLD);
+	// sort the local chunk once: from now on every exchange is a linear merge of two sorted chunks
+	localSort(chunk, chunkSize);
 
-				printf("process %d has sent to process %d the chunk: ", processID, bin2int(binaryId, numberOfIterations));
-				printVector(chunk, chunkSize); printf("\n");
+	// buffers for the partner's elements and for the ones of ours they are merged with, reused by every iteration
+	Element *newChunk=(Element*)malloc(sizeof(Element)*chunkSize);
+	Element *mergedChunk=(Element*)malloc(sizeof(Element)*chunkSize);
+	Element myBoundary, partnerBoundary;
+	int partner, sendStart, sendCount, newChunkSize;
+	long long elementsSent=0, chunkElements=0, totalElementsSent, totalChunkElements;
+	MPI_Status status;
 
-				// receive sorted data
-				MPI_Recv(chunk, chunkSize, MPI_INT, bin2int(binaryId, numberOfIterations), globalIterator+2+2*numberOfIterations, MPI_COMM_WORLD, NULL);
-				printf("process %d has received from process %d the chunk: ", processID, bin2int(binaryId, numberOfIterations));
-				printVector(chunk, chunkSize); printf("\n");
-			}
+	// stage k merges sequences of 2^(k+1) chunks: the first iteration flips the bits k, k-1, ..., 0 all together,
+	// then the following ones flip the bits k-1, ..., 0 one at a time (counted from the LSB)
+	for (stage=0; stage<numberOfIterations && chunkSize>0; stage++)
+		for (step=stage; step>=0; step--, globalIterator++){
+			int2bin(processID, binaryId, numberOfIterations);
 
-			// RECEIVER PART - otherwise
+			// compute the partner, flipping the interesting bits
+			int bit;
+			for (bit=(step==stage) ? 0 : step; bit<=step; bit++)
+				binaryId[numberOfIterations-bit-1]=1-binaryId[numberOfIterations-bit-1];
+			partner=bin2int(binaryId, numberOfIterations);
+
+			// a partner out of the virtual hypercube holds SENTINELs only: our chunk stays as it is
+			if (partner>=numberOfProcesses)
+				continue;
+
+			// first the partners swap just their boundary keys: the lower node its biggest element, the upper one its smallest
+			myBoundary=(processID<partner) ? chunk[chunkSize-1] : chunk[0];
+			MPI_Sendrecv(&myBoundary, 1, ELEMENT_MPI_TYPE, partner, globalIterator+2,
+					&partnerBoundary, 1, ELEMENT_MPI_TYPE, partner, globalIterator+2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+			// only the elements beyond the partner's boundary can cross it (binary search):
+			// the lower node sends its suffix bigger than the upper's smallest, the upper node its prefix smaller than the lower's biggest.
+			// The two counts are both zero when the chunks are already in order, and then the exchange is skipped
+			if (processID<partner){
+				sendStart=upperBound(chunk, chunkSize, partnerBoundary);
+				sendCount=chunkSize-sendStart;
+			}
 			else {
-
-				// receive data from that process
-				int *newChunk; int newChunkSize; binaryId[globalIterator]=0;
-				MPI_Recv(&newChunkSize, 1, MPI_INT, bin2int(binaryId, numberOfIterations), globalIterator+2, MPI_COMM_WORLD, NULL);
-				newChunk=(int*)malloc(sizeof(int)*newChunkSize);
-				MPI_Recv(newChunk, newChunkSize, MPI_INT, bin2int(binaryId, numberOfIterations), globalIterator+2+numberOfIterations, MPI_COMM_WORLD, NULL);
-
-				printf("process %d has received from process %d the chunk: ", processID, bin2int(binaryId, numberOfIterations));
-				printVector(newChunk, newChunkSize); printf("\n");
-
-				// put everything together
-				int i; int* commonChunk=(int*)malloc((newChunkSize+chunkSize)*sizeof(int));
-				for (i=0; i< chunkSize; i++)
-					commonChunk[i]=chunk[i];
-				for (i=0; i< newChunkSize; i++)
-					commonChunk[i+chunkSize]=newChunk[i];
-
-				// sort this common chunk
-				sort(commonChunk, newChunkSize+chunkSize);
-
-				for (i=0; i< newChunkSize; i++)
-					newChunk[i]=commonChunk[i];
-				for (i=newChunkSize; i<newChunkSize+chunkSize; i++)
-					chunk[i-newChunkSize]=commonChunk[i];
-
-				// send back part of data
-				MPI_Send(newChunk, newChunkSize, MPI_INT, bin2int(binaryId, numberOfIterations), globalIterator+2+2*numberOfIterations, MPI_COMM_WORLD);
-
-				printf("process %d has sent to process %d the chunk: ", processID, bin2int(binaryId, numberOfIterations));
-				printVector(newChunk, newChunkSize); printf("\n");
-
-				// free memory
-				free(newChunk);
-				free(commonChunk);
+				sendStart=0;
+				sendCount=lowerBound(chunk, chunkSize, partnerBoundary);
 			}
+			chunkElements+=chunkSize;
+			if (sendCount==0)
+				continue;
+
+			MPI_Sendrecv(chunk+sendStart, sendCount, ELEMENT_MPI_TYPE, partner, globalIterator+2,
+					newChunk, chunkSize, ELEMENT_MPI_TYPE, partner, globalIterator+2, MPI_COMM_WORLD, &status);
+			MPI_Get_count(&status, ELEMENT_MPI_TYPE, &newChunkSize);
+			elementsSent+=sendCount;
+
+			printf("process %d has received from process %d the elements: ", processID, partner);
+			printVector(newChunk, newChunkSize); printf("\n");
+
+			// the rest of the chunk stays where it is: just the part that was sent is merged with what arrived
+			// the lower node keeps the low part, the upper one keeps the high part
+			memcpy(mergedChunk, chunk+sendStart, sizeof(Element)*sendCount);
+			if (processID<partner)
+				mergeLow(mergedChunk, sendCount, newChunk, newChunkSize, chunk+sendStart, sendCount);
+			else
+				mergeHigh(mergedChunk, sendCount, newChunk, newChunkSize, chunk, sendCount);
 
+			printf("process %d has kept the chunk: ", processID);
+			printVector(chunk, chunkSize); printf("\n");
 		}
 
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime=MPI_Wtime();
+	if (processID==MASTER)
+		printf("sorting time with %d processes: %f s\n", numberOfProcesses, endTime-startTime);
 
-		// END OF COMPUTATION; NOW NODE 0 HAS THE FIRST SORTED CHUNK, NODE 1 THE SECOND, AND SO ON
+	// how many elements have been moved, against the whole chunks that a plain exchange would have sent
+	MPI_Reduce(&elementsSent, &totalElementsSent, 1, MPI_LONG_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+	MPI_Reduce(&chunkElements, &totalChunkElements, 1, MPI_LONG_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+	if (processID==MASTER && totalChunkElements>0)
+		printf("exchanged elements: %lld of %lld (%.1f%%)\n", totalElementsSent, totalChunkElements, 100.0*totalElementsSent/totalChunkElements);
 
-		// so each slave sends his chunk to the master
-		if (processID>MASTER){
-			MPI_Send(&chunkSize, 1, MPI_INT, MASTER, 3*numberOfIterations+50, MPI_COMM_WORLD);
-			MPI_Send(chunk, chunkSize, MPI_INT, MASTER, 3*numberOfIterations+51, MPI_COMM_WORLD);
-		}
 
-		// while the master will write the result in the output file
-		else {
-			FILE *outputFilePtr=fopen(outputFile, "wb");
+	// END OF COMPUTATION; NOW NODE 0 HAS THE FIRST SORTED CHUNK, NODE 1 THE SECOND, AND SO ON
+	// and all the SENTINELs are at the end of the last chunks
 
-			if (outputFilePtr!=NULL){
-				int newChunkSize, it, jt; int* newChunk;
+	// PARALLEL I/O: each node writes its own part (without SENTINELs) in the output file
+	if (PARALLEL_IO){
+		int outputSize=outputChunkSize(processID, chunkSize, totalNumberOfElements);
+		printf("process %d final data: ", processID);
+		printVector(chunk, outputSize); printf("\n");
+		writeChunkParallel(outputFile, chunk, outputSize, (MPI_Offset)processID*chunkSize, totalNumberOfElements);
+	}
+
+	// otherwise each slave sends his chunk (without SENTINELs) to the master
+	else if (processID>MASTER){
+		int outputSize=outputChunkSize(processID, chunkSize, totalNumberOfElements);
+		MPI_Send(&outputSize, 1, MPI_INT, MASTER, 3*numberOfIterations+50, MPI_COMM_WORLD);
+		MPI_Send(chunk, outputSize, ELEMENT_MPI_TYPE, MASTER, 3*numberOfIterations+51, MPI_COMM_WORLD);
+	}
 
-				// write master's part first
-				printf("master's final data: ");
-				printVector(chunk, chunkSize); printf("\n");
-				for (jt=0; jt<chunkSize; jt++)
-					fwrite(&chunk[jt], 1, sizeof(int), outputFilePtr);
+	// while the master will write the result in the output file
+	else {
+		FILE *outputFilePtr=fopen(outputFile, "wb");
+
+		if (outputFilePtr!=NULL){
+			int newChunkSize, it;
 
-				// for each slave
-				for (it=1; it<numberOfProcesses; it++){
+			// write master's part first
+			newChunkSize=outputChunkSize(MASTER, chunkSize, totalNumberOfElements);
+			printf("master's final data: ");
+			printVector(chunk, newChunkSize); printf("\n");
+			fwrite(chunk, sizeof(Element), newChunkSize, outputFilePtr);
 
-					// receive data from it
-					MPI_Recv(&newChunkSize, 1, MPI_INT, it, 3*numberOfIterations+50, MPI_COMM_WORLD, NULL);
-					newChunk=(int*)malloc(newChunkSize*sizeof(int));
-					MPI_Recv(newChunk, newChunkSize, MPI_INT, it, 3*numberOfIterations+51, MPI_COMM_WORLD, NULL);
+			// for each slave
+			for (it=1; it<numberOfProcesses; it++){
 
-					printf("master has received final data from process %d: ", it);
+				// receive data from it
+				MPI_Recv(&newChunkSize, 1, MPI_INT, it, 3*numberOfIterations+50, MPI_COMM_WORLD, NULL);
+				MPI_Recv(newChunk, newChunkSize, ELEMENT_MPI_TYPE, it, 3*numberOfIterations+51, MPI_COMM_WORLD, NULL);
 
-					// print the result (just for test)
-					printVector(newChunk, newChunkSize); printf("\n");
+				printf("master has received final data from process %d: ", it);
 
-					// write it into the output file
-					for (jt=0; jt<newChunkSize; jt++)
-						fwrite(&newChunk[jt], 1, sizeof(int), outputFilePtr);
-				}
+				// print the result (just for test)
+				printVector(newChunk, newChunkSize); printf("\n");
 
-				free (newChunk);
-				fclose(outputFilePtr);
+				// write it into the output file
+				fwrite(newChunk, sizeof(Element), newChunkSize, outputFilePtr);
 			}
-			else
-				printf ("error while opening the file\n");
-		}
 
-		free(chunk);
+			fclose(outputFilePtr);
+		}
+		else
+			printf ("error while opening the file\n");
+	}
 
-	} else if(processID==MASTER) printf("********** TERMINATION. Number of processes isn't a power of 2 **********\n");
+	free(newChunk);
+	free(mergedChunk);
+	free(chunk);
 
 	MPI_Finalize();
 	return 0;
 }
 
 
-// SIMPLE SORTING FUNCTION (BUBBLE SORT)
-void sort (int* vector, int size){
-	int i, j, tmp;
-	for (i = 0 ; i < size-1; i++)
-		for (j = 0 ; j<size-1; j++)
-			if (vector[j] > vector[j+1]){
-				tmp=vector[j];
-				vector[j]=vector[j+1];
-				vector[j+1]=tmp;
-			}
-}
-
-// COMPUTES THE NUMBER OF BITS NEEDED FOR REPRESENTING AN INT
+// COMPUTES THE NUMBER OF BITS NEEDED FOR REPRESENTING THE RANKS 0..PROCNUM-1
+// (that is, the dimension of the smallest hypercube containing procNum nodes)
 int computeNumberOfBits(int procNum){
 	int k=0;
-	while (((procNum % 2) == 0) && procNum > 1){
-		procNum /= 2;
+	while ((1<<k) < procNum)
 		k++;
-	}
-	if (procNum == 1)
-		return k;
-	else
-		return -1;
+	return k;
+}
+
+// READS SIZE NUMBERS FROM THE FILE, FILLING WITH SENTINEL WHAT IS MISSING AT THE END OF THE FILE
+void readChunk(FILE* filePtr, Element* chunk, int size){
+	int it=fread(chunk, sizeof(Element), size, filePtr);
+	for (; it<size; it++)
+		chunk[it]=SENTINEL;
+}
+
+// EACH PROCESS READS ITS OWN CHUNKSIZE NUMBERS FROM THE INPUT FILE (COLLECTIVELY), FILLING WITH SENTINEL WHAT IS MISSING
+// NOTE: unlike the balanced chunks of SortIO.h, all the chunks have the same size, ceil(n/p)
+Element* readPaddedChunkParallel(int id, int numberOfProcesses, int* totalNumberOfElements, int* chunkSize){
+	MPI_File inputFileHandle=openSortInputFile(inputFile);
+	int it, size;
+	Element *chunk;
+
+	// everybody reads the number of elements, then computes its part
+	MPI_File_read_at_all(inputFileHandle, 0, totalNumberOfElements, 1, MPI_INT, MPI_STATUS_IGNORE);
+	*chunkSize=(*totalNumberOfElements+numberOfProcesses-1)/numberOfProcesses;
+	size=outputChunkSize(id, *chunkSize, *totalNumberOfElements);
+
+	chunk=(Element*)malloc(sizeof(Element)*(*chunkSize));
+	MPI_File_read_at_all(inputFileHandle, sizeof(int)+(MPI_Offset)id*(*chunkSize)*sizeof(Element), chunk, size, ELEMENT_MPI_TYPE, MPI_STATUS_IGNORE);
+	MPI_File_close(&inputFileHandle);
+
+	for (it=size; it<*chunkSize; it++)
+		chunk[it]=SENTINEL;
+	return chunk;
+}
+
+// COMPUTES HOW MANY ELEMENTS (NOT SENTINELS) FALL IN THE ID-TH CHUNK OF THE FILES
+int outputChunkSize(int id, int chunkSize, int totalNumberOfElements){
+	int size=totalNumberOfElements-id*chunkSize;
+	if (size<0)
+		return 0;
+	return (size<chunkSize) ? size : chunkSize;
 }
 
 // COMPUTES THE BINARY REPRESENTATION OF AN INTEGER, USING EXACTLY BITSNUMBER BITS
@@ -302,68 +382,3 @@ int bin2int(int* bin, int size){
 		res+=bin[i]*pow(2,size-i-1);
 	return res;
 }
-
-
-// auxiliary functions, just for testing purpose
-// generates n random numbers between 0 and 2n, writes them in the input file and prints them too
-void fillInputFile(char* file, int n){
-	FILE *fp=fopen(file, "wb");
-	if (fp!=NULL){
-		int i, r;
-		fwrite(&n, sizeof(int), 1, fp);
-		printf("vector = [");
-		for (i=0; i<n-1; i++){
-			r = rand()%(n*2);
-			fwrite(&r, sizeof(int), 1, fp);
-			printf("%d, ", r);
-		}
-		r = rand()%(n*2);
-		fwrite(&r, sizeof(int), 1, fp);
-		printf("%d]", r);
-		fclose(fp);
-	}
-}
-
-// generates 2n random numbers between 0 and 4n in a bitonic order, writes them in the input file and prints them too
-void fillBitonicInputFile(char* file, int n){
-	FILE *fp=fopen(file, "wb");
-	if (fp!=NULL){
-		int i; int r[n];
-		n*=2;
-		fwrite(&n, sizeof(int), 1, fp);
-
-		for (i=0; i<n/2; i++)
-			r[i] = rand()%(n*2);
-
-		sort(r, n/2);
-		printf("vector = [");
-
-
-		for (i=0; i<n/2; i++){
-			fwrite(&r[i], sizeof(int), 1, fp);
-			printf("%d, ", r[i]);
-			r[i] = rand()%(n*2);
-		}
-
-		sort(r, n/2);
-
-		for (i=n/2-1; i>0; i--){
-			fwrite(&r[i], sizeof(int), 1, fp);
-			printf("%d, ", r[i]);
-		}
-
-		fwrite(&r[0], sizeof(int), 1, fp);
-		printf("%d]", r[0]);
-
-		fclose(fp);
-	}
-}
-
-// prints a vector
-void printVector(int* vector, int n){
-	int i;
-	printf("[");
-	for (i=0; i<n-1; i++)
-		printf("%d, ", vector[i]);
-	printf("%d]", vector[n-1]);
-}
@@ -0,0 +1,124 @@
+/*
+ * Converts an input file of MatrixVectorProduct.c (dense A) into an input file of SparseMatrixVectorProduct.c (A in CSR format)
+ *
+ * USAGE: DenseToCSR [-k vectors] denseFile csrFile
+ *  -k = number of vectors in the dense file (default 1)
+ *
+ * denseFile's structure (see MatrixVectorProduct.c):
+ * int = the size n
+ * k*n doubles = the vectors x, one after another
+ * n*n doubles = matrix A row by row
+ *
+ * csrFile's structure:
+ * int = the size n
+ * int = the number of vectors k
+ * long long = the number of nonzeros nnz of A
+ * k*n doubles = the vectors x, one after another (as in the dense file)
+ * n+1 long long = the row pointers: the nonzeros of row i are the ones from rowPointers[i] to rowPointers[i+1]-1
+ * nnz int = the column of each nonzero, row by row (and by increasing column in each row)
+ * nnz doubles = the value of each nonzero, in the same order
+ *
+ * PROCEDURE:
+ * A does not fit in memory, so it's read twice, a row at a time: the first pass counts the nonzeros of each row (the row pointers),
+ * so the offset of each section is known, and the second one writes the columns and the values of each row in their sections
+ * (just the row pointers are kept in memory)
+ *
+ * compile with: gcc -O2 -o DenseToCSR DenseToCSR.c (a serial program: it needs no MPI)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int main(int argc, char **argv){
+
+	int n, numberOfVectors=1, option, i, j;
+	long long nonzeros;
+
+	while ((option=getopt(argc, argv, "k:"))!=-1){
+		if (option=='k')
+			numberOfVectors=atoi(optarg);
+		else
+			optind=argc+1;
+	}
+	if (optind!=argc-2 || numberOfVectors<1){
+		printf("usage: %s [-k vectors] denseFile csrFile\n", argv[0]);
+		return 1;
+	}
+
+	FILE *denseFile=fopen(argv[optind], "rb");
+	if (denseFile==NULL || fread(&n, sizeof(int), 1, denseFile)!=1){
+		printf("error while opening the dense file\n");
+		return 1;
+	}
+
+	double *line=(double*)malloc(sizeof(double)*(n>0 ? n : 1));
+	long long *rowPointers=(long long*)malloc(sizeof(long long)*(n+1));
+	long rowsOffset=sizeof(int)+(long)numberOfVectors*n*sizeof(double);
+
+
+	// FIRST PASS: the nonzeros of each row
+	fseek(denseFile, rowsOffset, SEEK_SET);
+	rowPointers[0]=0;
+	for (i=0; i<n; i++){
+		if (fread(line, sizeof(double), n, denseFile)!=(size_t)n){
+			printf("the dense file is too short\n");
+			return 1;
+		}
+		rowPointers[i+1]=rowPointers[i];
+		for (j=0; j<n; j++)
+			if (line[j]!=0.0)
+				rowPointers[i+1]++;
+	}
+	nonzeros=rowPointers[n];
+
+
+	// the header, the vectors and the row pointers
+	FILE *csrFile=fopen(argv[optind+1], "wb");
+	if (csrFile==NULL){
+		printf("error while opening the csr file\n");
+		return 1;
+	}
+	fwrite(&n, sizeof(int), 1, csrFile);
+	fwrite(&numberOfVectors, sizeof(int), 1, csrFile);
+	fwrite(&nonzeros, sizeof(long long), 1, csrFile);
+
+	fseek(denseFile, sizeof(int), SEEK_SET);
+	for (i=0; i<numberOfVectors; i++){
+		if (fread(line, sizeof(double), n, denseFile)!=(size_t)n){
+			printf("the dense file is too short\n");
+			return 1;
+		}
+		fwrite(line, sizeof(double), n, csrFile);
+	}
+	fwrite(rowPointers, sizeof(long long), n+1, csrFile);
+
+
+	// SECOND PASS: the columns go right after the row pointers, the values after the columns (through a second stream on the same file)
+	long columnsOffset=ftell(csrFile);
+	FILE *valuesFile=fopen(argv[optind+1], "r+b");
+	if (valuesFile==NULL){
+		printf("error while opening the csr file\n");
+		return 1;
+	}
+	fseek(valuesFile, columnsOffset+nonzeros*sizeof(int), SEEK_SET);
+
+	for (i=0; i<n; i++){
+		if (fread(line, sizeof(double), n, denseFile)!=(size_t)n){
+			printf("the dense file is too short\n");
+			return 1;
+		}
+		for (j=0; j<n; j++)
+			if (line[j]!=0.0){
+				fwrite(&j, sizeof(int), 1, csrFile);
+				fwrite(&line[j], sizeof(double), 1, valuesFile);
+			}
+	}
+
+	printf("size %d, %d vectors, %lld nonzeros (%.3f%% of A)\n", n, numberOfVectors, nonzeros, (n>0) ? 100.0*nonzeros/((double)n*n) : 0.0);
+
+	fclose(denseFile); fclose(csrFile); fclose(valuesFile);
+	free(line); free(rowPointers);
+	return 0;
+}
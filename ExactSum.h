@@ -0,0 +1,130 @@
+/*
+ * Exact (so reproducible) summation of doubles, shared by the matrix programs (MatrixVectorProduct.c)
+ *
+ * An ExactSum is a fixed-point number wide enough for any double: EXACT_SUM_DIGITS digits of 32 bits each,
+ * digit d weighing 2^(32*d-EXACT_SUM_BIAS) (from below the smallest subnormal to above the biggest double).
+ * Each digit is kept in a long long, so the 53 bits of a double are added to 3 digits without any carry, and the carries
+ * are propagated just every EXACT_SUM_CARRIES additions (exactSumNormalize): no rounding ever happens,
+ * so the sum is the same whatever the order of the additions, the number of processes or the shape of the reduction tree.
+ *
+ * exactSumAdd(sum, v) adds a double, exactSumAddProduct(sum, a, b) adds the exact product a*b (the rounded one plus its error, by FMA)
+ * exactSumValue(sum) converts the sum to a double, from the most significant digit down (so the same sum always gives the same double)
+ * exactSumMPI(&type, &op) creates the datatype of an ExactSum and the MPI_Op adding them, for MPI_Reduce/MPI_Allreduce
+ *
+ * NOTE: header only, so that each program is still compiled from its own single source file
+ *
+ */
+
+#ifndef EXACT_SUM_H
+#define EXACT_SUM_H
+
+#include <mpi.h>
+#include <math.h>
+
+// digits of 32 bits, and the weight of the least significant one (2^-EXACT_SUM_BIAS)
+#define EXACT_SUM_DIGITS 70
+#define EXACT_SUM_BIAS 1152
+
+// additions between two normalizations: each one changes a digit by less than 2^33, and a digit has 63 bits
+#define EXACT_SUM_CARRIES (1<<28)
+
+typedef struct {
+	long long digit[EXACT_SUM_DIGITS];
+	int additions;
+} ExactSum;
+
+
+// PROPAGATES THE CARRIES: EACH DIGIT BUT THE MOST SIGNIFICANT ONE (WHICH KEEPS THE SIGN) GOES BACK TO [0, 2^32)
+// NOTE: the normalized form of a number is unique, so equal sums have equal digits
+static inline void exactSumNormalize(ExactSum* sum){
+	long long carry;
+	int d;
+	for (d=0; d<EXACT_SUM_DIGITS-1; d++){
+		carry=sum->digit[d]>>32;
+		sum->digit[d]-=carry*4294967296LL;
+		sum->digit[d+1]+=carry;
+	}
+	sum->additions=0;
+}
+
+// ADDS V TO THE SUM (INFINITIES AND NANS ARE NOT SUPPORTED)
+static inline void exactSumAdd(ExactSum* sum, double v){
+	unsigned long long mantissa, low, high;
+	int exponent, position, shift, d;
+
+	if (v==0.0)
+		return;
+
+	// v = mantissa * 2^(exponent-53), with an integer mantissa of 53 bits, whose lowest bit is bit position of the digits
+	mantissa=(unsigned long long)ldexp(fabs(frexp(v, &exponent)), 53);
+	position=exponent-53+EXACT_SUM_BIAS;
+	d=position/32;
+	shift=position%32;
+
+	// mantissa << shift takes 3 digits at most: each of them gets its 32 bits
+	low=(mantissa&0xFFFFFFFFULL)<<shift;
+	high=(mantissa>>32)<<shift;
+	if (v>0){
+		sum->digit[d]+=(long long)(low&0xFFFFFFFFULL);
+		sum->digit[d+1]+=(long long)((low>>32)+(high&0xFFFFFFFFULL));
+		sum->digit[d+2]+=(long long)(high>>32);
+	}
+	else {
+		sum->digit[d]-=(long long)(low&0xFFFFFFFFULL);
+		sum->digit[d+1]-=(long long)((low>>32)+(high&0xFFFFFFFFULL));
+		sum->digit[d+2]-=(long long)(high>>32);
+	}
+
+	if (++sum->additions==EXACT_SUM_CARRIES)
+		exactSumNormalize(sum);
+}
+
+// ADDS THE EXACT PRODUCT A*B: ITS ROUNDED VALUE AND ITS ROUNDING ERROR (COMPUTED EXACTLY BY THE FMA)
+static inline void exactSumAddProduct(ExactSum* sum, double a, double b){
+	double product=a*b;
+	exactSumAdd(sum, product);
+	exactSumAdd(sum, fma(a, b, -product));
+}
+
+// THE SUM AS A DOUBLE
+// NOTE: a negative sum is normalized to a most significant digit of -1 (way out of the range of the doubles) over positive digits,
+// so its magnitude is converted instead
+static inline double exactSumValue(const ExactSum* sum){
+	ExactSum magnitude=*sum;
+	double value=0.0, sign=1.0;
+	int d;
+
+	exactSumNormalize(&magnitude);
+	if (magnitude.digit[EXACT_SUM_DIGITS-1]<0){
+		for (d=0; d<EXACT_SUM_DIGITS; d++)
+			magnitude.digit[d]=-magnitude.digit[d];
+		exactSumNormalize(&magnitude);
+		sign=-1.0;
+	}
+
+	for (d=EXACT_SUM_DIGITS-1; d>=0; d--)
+		value+=ldexp((double)magnitude.digit[d], 32*d-EXACT_SUM_BIAS);
+	return sign*value;
+}
+
+// THE MPI_OP: INOUT[I] += IN[I], DIGIT BY DIGIT
+// NOTE: the operands must be normalized (so that no digit overflows): the results of exactSumMPI's operation are
+static void exactSumCombine(void* in, void* inout, int* length, MPI_Datatype* type){
+	ExactSum *a=(ExactSum*)in, *b=(ExactSum*)inout;
+	int i, d;
+	(void)type;
+	for (i=0; i<*length; i++){
+		for (d=0; d<EXACT_SUM_DIGITS; d++)
+			b[i].digit[d]+=a[i].digit[d];
+		exactSumNormalize(&b[i]);
+	}
+}
+
+// DATATYPE OF AN EXACTSUM (A SINGLE ELEMENT, SO THAT THE LIBRARY NEVER SPLITS ONE) AND THE OPERATION ADDING THEM (EXACT, SO COMMUTATIVE)
+static inline void exactSumMPI(MPI_Datatype* type, MPI_Op* op){
+	MPI_Type_contiguous(sizeof(ExactSum), MPI_BYTE, type);
+	MPI_Type_commit(type);
+	MPI_Op_create(exactSumCombine, 1, op);
+}
+
+#endif
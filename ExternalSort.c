@@ -0,0 +1,359 @@
+/*
+ * Implementation of distributed external-memory (out-of-core) sample sort, for inputs bigger than the memory of the nodes
+ *
+ * FILE STRUCTURE:
+ * first line= integer representing the number of elements
+ * other lines= an element to be sorted for each line (an int by default, see SortElement.h)
+ * (the output file contains just the sorted elements, like the ones of the other sorts)
+ *
+ * PROCEDURE:
+ * Each node reads its own part (shard) of the input file in runs of RUN_SIZE elements,
+ * sorts each run and spills it to a local temporary file, keeping p regular samples of it
+ * The master gathers and sorts all the samples, and chooses p-1 splitters at regular positions
+ * Then each node reads its runs back one at a time: the splitters divide a run in p buckets, and bucket k goes to node k
+ * (MPI_Alltoallv, at most RUN_SIZE/p elements for each node at a time, so nobody receives more than RUN_SIZE elements at once);
+ * what a node receives is sorted and spilled as a new run to another local temporary file
+ * Finally each node merges its runs with a heap, reading and writing RUN_SIZE/(k+1) elements at a time,
+ * and writes the result in the output file, right after the elements of the nodes before it
+ *
+ * The load imbalance (biggest part over the average one) is printed by the master
+ *
+ * ASSUMPTION:
+ *  - shared file-system for the input and the output file (MPI-IO), local disk for the temporary files (tmpfile)
+ *  - a node can handle about 3*RUN_SIZE elements in memory, whatever the size of the input
+ *
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "LocalSort.h"
+#include "SortIO.h"
+
+#define MASTER 0
+#define inputFile "../data/input.bin"
+#define outputFile "../data/output.bin"
+
+// number of random elements written in the input file (override with -DNUMBER_OF_ELEMENTS=...)
+#ifndef NUMBER_OF_ELEMENTS
+#define NUMBER_OF_ELEMENTS 15
+#endif
+
+// number of elements sorted in memory at a time (override with -DRUN_SIZE=...)
+#ifndef RUN_SIZE
+#define RUN_SIZE 1048576
+#endif
+
+typedef struct {
+	ElementKey value;
+	int source;
+} HeapNode;
+
+FILE* openTemporaryFile(void);
+int spillRuns(MPI_File, MPI_Offset, long long, FILE*, Element*, Element*, int);
+int loadRun(FILE*, long long*, Element*);
+void loadBlock(FILE*, long long, int, Element*);
+long long mergeSpilledRuns(FILE*, long long*, int, MPI_File, MPI_Offset);
+void siftDown(HeapNode*, int, int);
+
+int main (int argc, char** argv){
+
+	// common local variable declaration
+	int processID, numberOfProcesses, totalNumberOfElements;
+	double startTime, endTime;
+
+	// init mpi environment
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+
+	// write something in the input file
+	if (processID==MASTER)
+		fillInputFile(inputFile, NUMBER_OF_ELEMENTS);
+
+	// the input file must be complete before anybody opens it
+	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_File inputFileHandle=openSortInputFile(inputFile);
+
+	// everybody reads the number of elements, then computes its shard: the first rest processes get one more element
+	int shardSize;
+	MPI_Offset shardOffset;
+	MPI_File_read_at_all(inputFileHandle, 0, &totalNumberOfElements, 1, MPI_INT, MPI_STATUS_IGNORE);
+	balancedChunk(processID, numberOfProcesses, totalNumberOfElements, &shardSize, &shardOffset);
+
+	FILE *runFile=openTemporaryFile(), *bucketFile=openTemporaryFile();
+	Element *run=(Element*)malloc(sizeof(Element)*RUN_SIZE);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime=MPI_Wtime();
+
+	// FIRST PASS: SORTED RUNS ON THE LOCAL DISK, AND REGULAR SAMPLES OF EACH OF THEM
+	int maxRuns=(int)((shardSize+RUN_SIZE-1)/RUN_SIZE);
+	Element *samples=(Element*)malloc(sizeof(Element)*((long)maxRuns*numberOfProcesses+1));
+	int numberOfRuns=spillRuns(inputFileHandle, shardOffset, shardSize, runFile, run, samples, numberOfProcesses);
+	MPI_File_close(&inputFileHandle);
+
+	printf("process %d has spilled %d elements in %d runs\n", processID, shardSize, numberOfRuns);
+
+
+	// the master chooses the splitters at regular positions among all the samples
+	int i, numberOfSamples=numberOfRuns*numberOfProcesses;
+	int sampleCounts[numberOfProcesses], sampleOffsets[numberOfProcesses];
+	Element splitters[numberOfProcesses], *allSamples=NULL;
+
+	MPI_Gather(&numberOfSamples, 1, MPI_INT, sampleCounts, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+	if (processID==MASTER){
+		numberOfSamples=0;
+		for (i=0; i<numberOfProcesses; i++){
+			sampleOffsets[i]=numberOfSamples;
+			numberOfSamples+=sampleCounts[i];
+		}
+		allSamples=(Element*)malloc(sizeof(Element)*(numberOfSamples+1));
+	}
+	MPI_Gatherv(samples, numberOfRuns*numberOfProcesses, ELEMENT_MPI_TYPE,
+			allSamples, sampleCounts, sampleOffsets, ELEMENT_MPI_TYPE, MASTER, MPI_COMM_WORLD);
+	free(samples);
+
+	if (processID==MASTER){
+		localSort(allSamples, numberOfSamples);
+		for (i=1; i<numberOfProcesses; i++)
+			splitters[i-1]=(numberOfSamples>0) ? allSamples[(long)i*numberOfSamples/numberOfProcesses] : makeElement(KEY_MAX);
+		free(allSamples);
+
+		printf("splitters: ");
+		printVector(splitters, numberOfProcesses-1); printf("\n");
+	}
+	MPI_Bcast(splitters, numberOfProcesses-1, ELEMENT_MPI_TYPE, MASTER, MPI_COMM_WORLD);
+
+
+	// SECOND PASS: REDISTRIBUTION, ONE RUN AT A TIME
+	// bucket k of a run (elements in (splitter k-1, splitter k]) goes to node k, at most capacity elements at a time
+	int capacity=(RUN_SIZE/numberOfProcesses>0) ? RUN_SIZE/numberOfProcesses : 1;
+	int sendCounts[numberOfProcesses], sendOffsets[numberOfProcesses], bucketEnd[numberOfProcesses];
+	int receiveCounts[numberOfProcesses], receiveOffsets[numberOfProcesses];
+	int runSize=0, runsLeft=numberOfRuns, numberOfBuckets=0, received, runSent, somethingToSend, anybodySending;
+	long long runLength=0, *bucketLengths=NULL;
+	Element *bucket=(Element*)malloc(sizeof(Element)*capacity*numberOfProcesses);
+
+	rewind(runFile);
+	for (i=0; i<numberOfProcesses; i++)
+		sendOffsets[i]=bucketEnd[i]=0;
+
+	while (1){
+
+		// the current run has been sent completely: the next one is read and divided in buckets (a contiguous slice each)
+		do {
+			runSent=1;
+			for (i=0; i<numberOfProcesses; i++)
+				runSent&=(sendOffsets[i]==bucketEnd[i]);
+			if (runSent && runsLeft>0){
+				runSize=loadRun(runFile, &runLength, run);
+				runsLeft--;
+				for (i=0; i<numberOfProcesses; i++){
+					sendOffsets[i]=(i>0) ? bucketEnd[i-1] : 0;
+					bucketEnd[i]=(i<numberOfProcesses-1) ? upperBound(run, runSize, splitters[i]) : runSize;
+				}
+			}
+		} while (runSent && runsLeft>0);
+
+		somethingToSend=0;
+		for (i=0; i<numberOfProcesses; i++){
+			sendCounts[i]=(bucketEnd[i]-sendOffsets[i]<capacity) ? bucketEnd[i]-sendOffsets[i] : capacity;
+			somethingToSend|=(sendCounts[i]>0);
+		}
+
+		// everybody goes on until nobody has anything left
+		MPI_Allreduce(&somethingToSend, &anybodySending, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+		if (!anybodySending)
+			break;
+
+		// everybody tells everybody else how much it is going to send
+		MPI_Alltoall(sendCounts, 1, MPI_INT, receiveCounts, 1, MPI_INT, MPI_COMM_WORLD);
+		received=0;
+		for (i=0; i<numberOfProcesses; i++){
+			receiveOffsets[i]=received;
+			received+=receiveCounts[i];
+		}
+
+		MPI_Alltoallv(run, sendCounts, sendOffsets, ELEMENT_MPI_TYPE, bucket, receiveCounts, receiveOffsets, ELEMENT_MPI_TYPE, MPI_COMM_WORLD);
+		for (i=0; i<numberOfProcesses; i++)
+			sendOffsets[i]+=sendCounts[i];
+
+		// what arrived is made of p sorted slices: once sorted, it is a new run
+		if (received>0){
+			localSort(bucket, received);
+			fwrite(bucket, sizeof(Element), received, bucketFile);
+			bucketLengths=(long long*)realloc(bucketLengths, sizeof(long long)*(numberOfBuckets+1));
+			bucketLengths[numberOfBuckets++]=received;
+		}
+	}
+
+	free(bucket);
+	free(run);
+	fclose(runFile);
+
+
+	// LAST PASS: EACH NODE MERGES ITS RUNS AND WRITES THEM RIGHT AFTER THE ONES OF THE NODES BEFORE IT
+	long long partSize=0, position=0, biggestPart;
+	for (i=0; i<numberOfBuckets; i++)
+		partSize+=bucketLengths[i];
+	MPI_Exscan(&partSize, &position, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	if (processID==MASTER)
+		position=0;
+
+	MPI_File outputFileHandle=openSortOutputFile(outputFile, totalNumberOfElements);
+	mergeSpilledRuns(bucketFile, bucketLengths, numberOfBuckets, outputFileHandle, position);
+	MPI_File_close(&outputFileHandle);
+	fclose(bucketFile);
+	free(bucketLengths);
+
+	printf("process %d has merged %lld elements from %d runs, from position %lld\n", processID, partSize, numberOfBuckets, position);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime=MPI_Wtime();
+	if (processID==MASTER)
+		printf("sorting time (I/O included) with %d processes: %f s\n", numberOfProcesses, endTime-startTime);
+
+
+	// LOAD IMBALANCE: biggest part over the average one (1 = perfect balance)
+	MPI_Reduce(&partSize, &biggestPart, 1, MPI_LONG_LONG, MPI_MAX, MASTER, MPI_COMM_WORLD);
+	if (processID==MASTER && totalNumberOfElements>0)
+		printf("load imbalance: biggest part %lld elements, average %.1f, ratio %.3f\n", biggestPart,
+				(double)totalNumberOfElements/numberOfProcesses, (double)biggestPart*numberOfProcesses/totalNumberOfElements);
+
+	MPI_Finalize();
+	return 0;
+}
+
+
+// OPENS AN ANONYMOUS TEMPORARY FILE ON THE LOCAL DISK (REMOVED WHEN CLOSED)
+FILE* openTemporaryFile(void){
+	FILE *fp=tmpfile();
+	if (fp==NULL){
+		printf("error while opening a temporary file\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	return fp;
+}
+
+// READS THE SHARD IN RUNS OF RUN_SIZE ELEMENTS, SORTS THEM AND APPENDS THEM TO THE RUN FILE (EACH ONE AFTER ITS LENGTH)
+// p regular samples of each run are written in samples; returns the number of runs
+int spillRuns(MPI_File inputFileHandle, MPI_Offset shardOffset, long long shardSize, FILE* runFile, Element* run, Element* samples, int p){
+	long long done, runLength;
+	int i, numberOfRuns=0;
+
+	for (done=0; done<shardSize; done+=runLength, numberOfRuns++){
+		runLength=(shardSize-done<RUN_SIZE) ? shardSize-done : RUN_SIZE;
+		MPI_File_read_at(inputFileHandle, sizeof(int)+(shardOffset+done)*sizeof(Element), run, (int)runLength, ELEMENT_MPI_TYPE, MPI_STATUS_IGNORE);
+
+		localSort(run, (int)runLength);
+		for (i=0; i<p; i++)
+			samples[numberOfRuns*p+i]=run[(long)i*runLength/p];
+
+		fwrite(&runLength, sizeof(long long), 1, runFile);
+		fwrite(run, sizeof(Element), runLength, runFile);
+	}
+	return numberOfRuns;
+}
+
+// READS THE NEXT RUN OF THE RUN FILE IN RUN, RETURNING ITS LENGTH
+int loadRun(FILE* runFile, long long* runLength, Element* run){
+	if (fread(runLength, sizeof(long long), 1, runFile)!=1 || fread(run, sizeof(Element), *runLength, runFile)!=(size_t)*runLength){
+		printf("error while reading a temporary file\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	return (int)*runLength;
+}
+
+// READS LENGTH ELEMENTS OF THE RUN FILE, FROM THE OFFSET-TH ONE, IN BLOCK
+void loadBlock(FILE* runFile, long long offset, int length, Element* block){
+	if (fseeko(runFile, (off_t)offset*sizeof(Element), SEEK_SET)!=0 || fread(block, sizeof(Element), length, runFile)!=(size_t)length){
+		printf("error while reading a temporary file\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+}
+
+// MERGES THE K SORTED RUNS OF THE RUN FILE (ONE AFTER THE OTHER, WITH THE GIVEN LENGTHS) WITH A HEAP,
+// WRITING THEM IN THE OUTPUT FILE FROM THE POSITION-TH ELEMENT; RETURNS THE NUMBER OF ELEMENTS WRITTEN
+// NOTE: a block for each run plus the output block, RUN_SIZE elements altogether
+long long mergeSpilledRuns(FILE* runFile, long long* runLengths, int k, MPI_File outputFileHandle, MPI_Offset position){
+	int blockSize=(RUN_SIZE/(k+1)>0) ? RUN_SIZE/(k+1) : 1;
+	int i, heapSize=0, outputLength=0;
+	long long written=0, start=0;
+
+	Element *blocks=(Element*)malloc(sizeof(Element)*blockSize*(k+1)), *output=blocks+(long)blockSize*k;
+	long long *nextOffset=(long long*)malloc(sizeof(long long)*(k+1)), *remaining=(long long*)malloc(sizeof(long long)*(k+1));
+	int *blockLength=(int*)malloc(sizeof(int)*(k+1)), *blockPosition=(int*)malloc(sizeof(int)*(k+1));
+	HeapNode *heap=(HeapNode*)malloc(sizeof(HeapNode)*(k+1));
+
+	// the first block of each run
+	for (i=0; i<k; i++){
+		nextOffset[i]=start;
+		start+=runLengths[i];
+		blockLength[i]=(runLengths[i]<blockSize) ? (int)runLengths[i] : blockSize;
+		remaining[i]=runLengths[i]-blockLength[i];
+		blockPosition[i]=0;
+
+		loadBlock(runFile, nextOffset[i], blockLength[i], &blocks[(long)i*blockSize]);
+		nextOffset[i]+=blockLength[i];
+
+		heap[heapSize].value=ELEMENT_KEY(blocks[(long)i*blockSize]);
+		heap[heapSize].source=i;
+		heapSize++;
+	}
+	for (i=heapSize/2-1; i>=0; i--)
+		siftDown(heap, heapSize, i);
+
+	while (heapSize>0){
+		int source=heap[0].source;
+		output[outputLength++]=blocks[(long)source*blockSize+blockPosition[source]];
+
+		// the output block is full: write it
+		if (outputLength==blockSize){
+			MPI_File_write_at(outputFileHandle, (position+written)*sizeof(Element), output, outputLength, ELEMENT_MPI_TYPE, MPI_STATUS_IGNORE);
+			written+=outputLength;
+			outputLength=0;
+		}
+
+		// the block of the winner ran dry: read the following one, if the run isn't over
+		if (++blockPosition[source]==blockLength[source]){
+			if (remaining[source]==0){
+				heap[0]=heap[--heapSize];
+				siftDown(heap, heapSize, 0);
+				continue;
+			}
+			blockLength[source]=(remaining[source]<blockSize) ? (int)remaining[source] : blockSize;
+			remaining[source]-=blockLength[source];
+			blockPosition[source]=0;
+
+			loadBlock(runFile, nextOffset[source], blockLength[source], &blocks[(long)source*blockSize]);
+			nextOffset[source]+=blockLength[source];
+		}
+
+		heap[0].value=ELEMENT_KEY(blocks[(long)source*blockSize+blockPosition[source]]);
+		siftDown(heap, heapSize, 0);
+	}
+
+	if (outputLength>0)
+		MPI_File_write_at(outputFileHandle, (position+written)*sizeof(Element), output, outputLength, ELEMENT_MPI_TYPE, MPI_STATUS_IGNORE);
+	written+=outputLength;
+
+	free(blocks); free(nextOffset); free(remaining); free(blockLength); free(blockPosition); free(heap);
+	return written;
+}
+
+// RESTORES THE HEAP PROPERTY (SMALLEST VALUE ON TOP) FROM NODE I DOWNWARDS
+void siftDown(HeapNode* heap, int size, int i){
+	HeapNode tmp;
+	int smallest;
+	while ((smallest=2*i+1)<size){
+		if (smallest+1<size && heap[smallest+1].value<heap[smallest].value)
+			smallest++;
+		if (heap[i].value<=heap[smallest].value)
+			return;
+		tmp=heap[i]; heap[i]=heap[smallest]; heap[smallest]=tmp;
+		i=smallest;
+	}
+}
@@ -7,30 +7,66 @@
  * Matrice A = grande
  * Matrice B = piccola
  *
+ * USAGE: KronecherProduct inputA inputB [output [inputX]]
+ * input files: int rows, int columns, then the doubles of the matrix row by row
+ *
+ * without output (test): the master first writes two small matrices in the input files, and prints the whole product at the end
+ * with output (streaming): the product is never stored anywhere but in the output file (the doubles of A (x) B row by row, no header).
+ * The rows of the product of a process (rowsB for each of its rows of A) are a contiguous slice of the file, so each process
+ * computes them OUTPUT_BLOCK doubles at a time, in their final order, and writes each block at its offset with a nonblocking write,
+ * while it computes the next one in a second buffer: no process needs more than 2 blocks of memory (plus its rows of A and B),
+ * and nothing goes through the master
+ * with output and inputX (operator): A (x) B is never formed at all, since (A (x) B) vec(X) = vec(B X A^T) (vec stacks the columns):
+ * X (same format, columnsB x columnsA) gives the matrix B X A^T (rowsB x rowsA) in output, in the same format.
+ * X can also be k of them side by side (columnsB x k*columnsA), for the product of A (x) B by a matrix of k columns:
+ * then output gets the k results side by side (rowsB x k*rowsA).
+ * Each process computes U = B X (a small product, the same everywhere) and then U_c A^T just for its rows of A
+ * (which are columns of the results): two products with the blocked kernel of MatrixKernel.h, in O(size of X + size of the result) memory
+ * instead of O(size of A (x) B); then everybody writes its columns of the results with a single collective write
+ *
+ * HYBRID MPI+THREADS: compiled with -fopenmp, each process computes its rows of the product with OMP_NUM_THREADS threads
+ * (only the master thread calls MPI: MPI_THREAD_FUNNELED), and its rows of A are touched first by them (see MatrixKernel.h)
+ *
  */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "MatrixKernel.h"
+#include "MatrixIO.h"
+
 #define MASTER 0
 
+// doubles of the product in each of the 2 output blocks of a process (streaming, override with -DOUTPUT_BLOCK=...)
+#ifndef OUTPUT_BLOCK
+#define OUTPUT_BLOCK 1048576
+#endif
+
 void fill(char*, char*);
+void kroneckerBlock(long, long, const double*, int, const double*, int, int, double*);
+void streamProduct(char*, const double*, int, int, int, int, const double*, int, int);
+void applyOperator(char*, char*, const double*, int, int, int, int, const double*, int, int);
 
-int main(int argc, char **argv){ // inputA, inputB
+int main(int argc, char **argv){ // inputA, inputB, [output, [inputX]]
 
-	int processId, numberOfProcesses;
-	MPI_Init(&argc, &argv);
+	int processId, numberOfProcesses, threadSupport;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
 	MPI_Comm_rank(MPI_COMM_WORLD, &processId);
 	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
 
-	if (argc!=3 && processId==MASTER){
+	if (processId==MASTER && threadSupport<MPI_THREAD_FUNNELED && kernelThreads()>1)
+		printf("Warning: the MPI library does not support MPI_THREAD_FUNNELED\n");
+
+	if ((argc<3 || argc>5) && processId==MASTER){
 		printf("Error in number of parameters\n");
 		MPI_Abort(MPI_COMM_WORLD, 0);
 	}
 
-	if (processId==MASTER)
+	// the test matrices must be complete before anybody opens them
+	if (argc==3 && processId==MASTER)
 		fill(argv[1], argv[2]);
+	MPI_Barrier(MPI_COMM_WORLD);
 
 
 	/****************************************************** MATRICE A **************************************************/
@@ -57,7 +93,7 @@ int main(int argc, char **argv){ // inputA, inputB
 
 	printf("proc %d rpp=%d, start=%d\n", processId, rowsAPerProcess, startingLine);
 
-	double *chunkA = malloc (rowsAPerProcess * columnsA * sizeof(double));
+	double *chunkA = allocateFirstTouch((long)rowsAPerProcess * columnsA);
 
 	fseek(inputFilePtr, startingLine * columnsA * sizeof(double) + 2 * sizeof(int), SEEK_SET);
 	fread(chunkA, rowsAPerProcess * columnsA, sizeof(double), inputFilePtr);
@@ -82,14 +118,34 @@ int main(int argc, char **argv){ // inputA, inputB
 	fclose (inputFilePtr);
 
 
-	/****************************************************** PRODOTTO **************************************************/
+	/****************************************************** OPERATOR **************************************************/
+
+	if (argc==5) {
+		applyOperator(argv[4], argv[3], chunkA, rowsA, columnsA, rowsAPerProcess, startingLine, chunkB, rowsB, columnsB);
+
+		free(chunkA); free(chunkB);
+		MPI_Finalize();
+		return 0;
+	}
+
 
-	double *result = malloc (rowsB * columnsB * rowsAPerProcess * columnsA * sizeof(double));
+	/****************************************************** STREAMING **************************************************/
 
-	for (int i = 0; i < rowsAPerProcess * columnsA; ++i)
-		for (int j = 0; j < rowsB * columnsB; ++j)
-			//     salto dei blocchi grandi                         salto delle righe                  salto delle colonne        // salto ultima colonna
-			result[(i/columnsA) * columnsA * rowsB * columnsB   +   (j/columnsB) * rowsA * rowsB   +   (i%columnsA) * rowsB   +   j%columnsB] = chunkA[i] * chunkB[j];
+	if (argc==4) {
+		streamProduct(argv[3], chunkA, rowsA, columnsA, rowsAPerProcess, startingLine, chunkB, rowsB, columnsB);
+
+		free(chunkA); free(chunkB);
+		MPI_Finalize();
+		return 0;
+	}
+
+
+	/****************************************************** PRODOTTO **************************************************/
+
+	// the result is stored by rows (columnsA * columnsB elements each): row r is row r/rowsB of A times row r%rowsB of B
+	int columnsResult = columnsA * columnsB;
+	double *result = malloc ((long)rowsB * columnsB * rowsAPerProcess * columnsA * sizeof(double));
+	kroneckerBlock(0, (long)rowsAPerProcess * rowsB * columnsResult, chunkA, columnsA, chunkB, rowsB, columnsB, result);
 
 
 	/****************************************************** STAMPA **************************************************/
@@ -98,7 +154,7 @@ int main(int argc, char **argv){ // inputA, inputB
 
 		for (int j = 0; j < rowsB * columnsB * rowsAPerProcess * columnsA; ++j) {
 			printf("%f ", result[j]);
-			if ((j+1) % (rowsA*rowsB) == 0)
+			if ((j+1) % columnsResult == 0)
 				printf("\n");
 		}
 
@@ -111,7 +167,7 @@ int main(int argc, char **argv){ // inputA, inputB
 
 			for (int j = 0; j < chunkSize ; ++j) {
 				printf("%f ", result[j]);
-				if ((j+1) % (rowsA*rowsB) == 0)
+				if ((j+1) % columnsResult == 0)
 					printf("\n");
 			}
 		}
@@ -130,6 +186,154 @@ int main(int argc, char **argv){ // inputA, inputB
 
 
 
+// WRITES IN BLOCK THE ELEMENTS FIRST..FIRST+COUNT-1 OF THE ROWS OF THE PRODUCT OF A PROCESS (BY ROWS, FROM ITS FIRST ONE)
+// element e is in row r = e/(columnsA*columnsB), which is row r/rowsB of A times row r%rowsB of B; in the row, it's in the block
+// of column i of A, so each segment of a row of B in the block is a row of B scaled by an element of A
+// (with OpenMP each thread computes a contiguous slice of the block)
+void kroneckerBlock(long first, long count, const double* chunkA, int columnsA, const double* chunkB, int rowsB, int columnsB, double* block){
+	long columnsResult = (long)columnsA * columnsB;
+	int slices = kernelThreads();
+
+	#pragma omp parallel for schedule(static)
+	for (int slice = 0; slice < slices; ++slice) {
+		long e = first + count * slice / slices, last = first + count * (slice+1) / slices;
+		while (e < last) {
+			long r = e / columnsResult, c = e % columnsResult;
+			double a = chunkA[(r/rowsB) * columnsA + c/columnsB];
+			const double *rowB = chunkB + (r%rowsB) * columnsB;
+			int j = c % columnsB;
+			long length = (columnsB - j < last - e) ? columnsB - j : last - e;
+
+			for (long l = 0; l < length; ++l)
+				block[e - first + l] = a * rowB[j + l];
+			e += length;
+		}
+	}
+}
+
+// STREAMING: EACH PROCESS COMPUTES ITS ROWS OF THE PRODUCT (ROWSB FOR EACH OF ITS ROWS OF A) OUTPUT_BLOCK DOUBLES AT A TIME,
+// AND WRITES EACH BLOCK AT ITS OFFSET IN THE OUTPUT FILE WHILE IT COMPUTES THE NEXT ONE
+void streamProduct(char *path, const double* chunkA, int rowsA, int columnsA, int rowsAPerProcess, int startingLine,
+		const double* chunkB, int rowsB, int columnsB){
+	int processId, numberOfProcesses;
+	long columnsResult = (long)columnsA * columnsB, total = (long)rowsAPerProcess * rowsB * columnsResult, count;
+	double *block = malloc(OUTPUT_BLOCK * sizeof(double)), *nextBlock = malloc(OUTPUT_BLOCK * sizeof(double)), *swap;
+	double startTime, endTime;
+	MPI_File outputHandle;
+	MPI_Request request;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &processId);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+	outputHandle = openOutputFile(MPI_COMM_WORLD, path, (MPI_Offset)rowsA * rowsB * columnsResult * sizeof(double));
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime = MPI_Wtime();
+
+	// the slice of the process starts at its first row of the product
+	MPI_Offset offset = (MPI_Offset)startingLine * rowsB * columnsResult * sizeof(double);
+	for (long first = 0; first < total; first += count) {
+		count = (total - first < OUTPUT_BLOCK) ? total - first : OUTPUT_BLOCK;
+		kroneckerBlock(first, count, chunkA, columnsA, chunkB, rowsB, columnsB, block);
+
+		// the previous block is written by now (its buffer is the next one to be filled)
+		if (first > 0)
+			MPI_Wait(&request, MPI_STATUS_IGNORE);
+		MPI_File_iwrite_at(outputHandle, offset + first * sizeof(double), block, (int)count, MPI_DOUBLE, &request);
+		swap = block; block = nextBlock; nextBlock = swap;
+	}
+	if (total > 0)
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+	MPI_File_close(&outputHandle);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime = MPI_Wtime();
+	if (processId==MASTER)
+		printf("product time with %d processes (streaming, I/O included): %f s, %ld x %ld doubles written\n", numberOfProcesses,
+				endTime-startTime, (long)rowsA * rowsB, columnsResult);
+
+	free(block); free(nextBlock);
+}
+
+// OPERATOR: THE RESULTS B X_C A^T OF THE K MATRICES X_C SIDE BY SIDE IN THE FILE PATHX, WITHOUT FORMING A (X) B
+// the process has rowsAPerProcess rows of A from startingLine: row a of A gives column a of each result, B X_c A[a]^T
+void applyOperator(char *pathX, char *pathY, const double* chunkA, int rowsA, int columnsA, int rowsAPerProcess, int startingLine,
+		const double* chunkB, int rowsB, int columnsB){
+	int processId, numberOfProcesses, rowsX, columnsX;
+	double startTime, endTime;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &processId);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime = MPI_Wtime();
+
+	// everybody reads the whole X (like B)
+	FILE *inputFilePtr = fopen(pathX, "rb");
+	if (inputFilePtr==NULL) {
+		if (processId==MASTER)
+			printf("Error while opening matrix X\n");
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	fread(&rowsX, 1, sizeof(int), inputFilePtr);
+	fread(&columnsX, 1, sizeof(int), inputFilePtr);
+	if (rowsX!=columnsB || columnsA==0 || columnsX % columnsA != 0) {
+		if (processId==MASTER)
+			printf("Error: X must be %d x (k * %d), not %d x %d\n", columnsB, columnsA, rowsX, columnsX);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	int numberOfMatrices = columnsX / columnsA;
+
+	double *matrixX = malloc(((long)rowsX * columnsX + 1) * sizeof(double));
+	double *columnsOfX = malloc(((long)rowsX * columnsX + 1) * sizeof(double));
+	fread(matrixX, (long)rowsX * columnsX, sizeof(double), inputFilePtr);
+	fclose(inputFilePtr);
+
+	// U = B X (rowsB x k*columnsA): the kernel wants X by columns
+	transpose(rowsX, columnsX, matrixX, columnsOfX);
+	free(matrixX);
+	double *matrixU = allocateFirstTouch((long)rowsB * columnsX);
+	multiplyBlock(rowsB, columnsX, columnsB, chunkB, columnsB, columnsOfX, columnsB, matrixU, columnsX);
+	free(columnsOfX);
+
+	// our columns of each result: U_c (columns c*columnsA.. of U) times our rows of A, which are the columns of A^T
+	// they are stored as rowsB x k x rowsAPerProcess, the layout of the part of the output file of the process
+	double *results = allocateFirstTouch((long)rowsB * numberOfMatrices * rowsAPerProcess);
+	for (int c = 0; c < numberOfMatrices; ++c)
+		multiplyBlock(rowsB, rowsAPerProcess, columnsA, matrixU + (long)c * columnsA, columnsX, chunkA, columnsA,
+				results + (long)c * rowsAPerProcess, numberOfMatrices * rowsAPerProcess);
+	free(matrixU);
+
+
+	// the output file is rowsB x k*rowsA (by rows), that is a rowsB x k x rowsA array: the process writes the columns
+	// startingLine.. of each of the k results with a subarray view
+	MPI_File outputHandle = openOutputFile(MPI_COMM_WORLD, pathY, 2 * sizeof(int) + (MPI_Offset)rowsB * numberOfMatrices * rowsA * sizeof(double));
+	MPI_Datatype view = MPI_DOUBLE;
+	int header[2] = {rowsB, numberOfMatrices * rowsA};
+	int sizes[3] = {rowsB, numberOfMatrices, rowsA}, subsizes[3] = {rowsB, numberOfMatrices, rowsAPerProcess}, starts[3] = {0, 0, startingLine};
+
+	if (processId==MASTER)
+		MPI_File_write_at(outputHandle, 0, header, 2, MPI_INT, MPI_STATUS_IGNORE);
+
+	// (an empty block writes nothing anyway)
+	if (rowsB>0 && numberOfMatrices>0 && rowsAPerProcess>0) {
+		MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &view);
+		MPI_Type_commit(&view);
+	}
+	MPI_File_set_view(outputHandle, 2 * sizeof(int), MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+	MPI_File_write_all(outputHandle, results, rowsB * numberOfMatrices * rowsAPerProcess, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&outputHandle);
+	if (view!=MPI_DOUBLE)
+		MPI_Type_free(&view);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime = MPI_Wtime();
+	if (processId==MASTER)
+		printf("operator time with %d processes (I/O included): %f s, %d results of %d x %d\n", numberOfProcesses,
+				endTime-startTime, numberOfMatrices, rowsB, rowsA);
+
+	free(results);
+}
+
 void fill(char *path1, char *path2){
 	FILE *f1 = fopen(path1, "wb");
 
@@ -0,0 +1,282 @@
+/*
+ * Local sorting kernels shared by the distributed sorts (BitonicSort.c, OddEvenSort.c, MergeSort.c, SampleSort.c, ExternalSort.c)
+ *
+ * localSort(vector, size) sorts a vector of Element (see SortElement.h) by key, with a bottom-up merge sort:
+ *  - short runs are sorted first (in-register sorting network of 8x8 ints with AVX2, insertion sort otherwise)
+ *  - then runs of doubling width are merged, ping-ponging between the vector and a buffer of the same size
+ *    (with AVX2, 8 ints at a time through a bitonic merging network)
+ *
+ * The AVX2 path is compiled for int elements when __AVX2__ is defined (e.g. mpicc -mavx2 or -march=native),
+ * otherwise (or for the other element types) the portable scalar path is used: the result is the same.
+ *
+ * mergeLow and mergeHigh are the compare-split kernels of the exchanges:
+ * they merge two sorted vectors keeping only the smallest (biggest) elements.
+ * Equal keys are ordered as if the lower node's elements came first, so the two partners never keep the same element;
+ * lowerBound and upperBound find the part of a chunk that can cross the boundary with the partner
+ *
+ * NOTE: header only, so that each program is still compiled from its own single source file
+ *
+ */
+
+#ifndef LOCAL_SORT_H
+#define LOCAL_SORT_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SortElement.h"
+
+// the sorting networks work on 8 ints per register
+#if defined(__AVX2__) && ELEMENT_TYPE==INT_ELEMENTS
+#define LOCAL_SORT_AVX2
+#include <immintrin.h>
+#endif
+
+// vectors up to this size are just insertion-sorted
+#define INSERTION_SORT_LIMIT 16
+
+#ifdef LOCAL_SORT_AVX2
+// ints sorted at a time by the in-register sorting network (8 registers of 8 ints)
+#define LOCAL_SORT_BLOCK 64
+// length of the runs it leaves behind
+#define LOCAL_SORT_RUN 8
+#else
+#define LOCAL_SORT_BLOCK 1
+#define LOCAL_SORT_RUN INSERTION_SORT_LIMIT
+#endif
+
+
+// SIMPLE SORTING FUNCTION FOR SHORT VECTORS (INSERTION SORT)
+static inline void insertionSort(Element* vector, int size){
+	int i, j;
+	Element tmp;
+	for (i=1; i<size; i++){
+		tmp=vector[i];
+		for (j=i; j>0 && ELEMENT_LESS(tmp, vector[j-1]); j--)
+			vector[j]=vector[j-1];
+		vector[j]=tmp;
+	}
+}
+
+// MERGES TWO SORTED VECTORS (OF ANY SIZE) IN OUT
+static inline void scalarMerge(const Element* a, int sizeA, const Element* b, int sizeB, Element* out){
+	int i=0, j=0, k=0, takeB;
+
+	// branchless: the comparison only decides which index moves forward
+	while (i<sizeA && j<sizeB){
+		takeB=ELEMENT_LESS(b[j], a[i]);
+		out[k++]=takeB ? b[j] : a[i];
+		j+=takeB;
+		i+=1-takeB;
+	}
+	while (i<sizeA)
+		out[k++]=a[i++];
+	while (j<sizeB)
+		out[k++]=b[j++];
+}
+
+
+#ifdef LOCAL_SORT_AVX2
+
+#define COMPARE_EXCHANGE(a, b) { __m256i tmp=_mm256_min_epi32(a, b); b=_mm256_max_epi32(a, b); a=tmp; }
+
+// SORTS A BITONIC REGISTER: HALF-CLEANERS AT DISTANCE 4, 2 AND 1
+static inline __m256i bitonicClean8(__m256i x){
+	__m256i y;
+	y=_mm256_permute2x128_si256(x, x, 0x01);
+	x=_mm256_blend_epi32(_mm256_min_epi32(x, y), _mm256_max_epi32(x, y), 0xF0);
+	y=_mm256_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+	x=_mm256_blend_epi32(_mm256_min_epi32(x, y), _mm256_max_epi32(x, y), 0xCC);
+	y=_mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+	x=_mm256_blend_epi32(_mm256_min_epi32(x, y), _mm256_max_epi32(x, y), 0xAA);
+	return x;
+}
+
+// MERGES TWO SORTED REGISTERS: THE 8 SMALLEST ELEMENTS END UP SORTED IN A, THE 8 BIGGEST IN B
+static inline void bitonicMerge16(__m256i* a, __m256i* b){
+	__m256i reversed=_mm256_permutevar8x32_epi32(*b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+	__m256i low=_mm256_min_epi32(*a, reversed), high=_mm256_max_epi32(*a, reversed);
+	*a=bitonicClean8(low);
+	*b=bitonicClean8(high);
+}
+
+// SORTS EACH COLUMN OF 8 REGISTERS (19 COMPARATORS), THEN TRANSPOSES THEM: EACH ROW OF 8 INTS ENDS UP SORTED
+static inline void sortBlock64(int* vector){
+	__m256i r0=_mm256_loadu_si256((__m256i*)(vector)), r1=_mm256_loadu_si256((__m256i*)(vector+8));
+	__m256i r2=_mm256_loadu_si256((__m256i*)(vector+16)), r3=_mm256_loadu_si256((__m256i*)(vector+24));
+	__m256i r4=_mm256_loadu_si256((__m256i*)(vector+32)), r5=_mm256_loadu_si256((__m256i*)(vector+40));
+	__m256i r6=_mm256_loadu_si256((__m256i*)(vector+48)), r7=_mm256_loadu_si256((__m256i*)(vector+56));
+	__m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+	COMPARE_EXCHANGE(r0, r2); COMPARE_EXCHANGE(r1, r3); COMPARE_EXCHANGE(r4, r6); COMPARE_EXCHANGE(r5, r7);
+	COMPARE_EXCHANGE(r0, r4); COMPARE_EXCHANGE(r1, r5); COMPARE_EXCHANGE(r2, r6); COMPARE_EXCHANGE(r3, r7);
+	COMPARE_EXCHANGE(r0, r1); COMPARE_EXCHANGE(r2, r3); COMPARE_EXCHANGE(r4, r5); COMPARE_EXCHANGE(r6, r7);
+	COMPARE_EXCHANGE(r2, r4); COMPARE_EXCHANGE(r3, r5);
+	COMPARE_EXCHANGE(r1, r4); COMPARE_EXCHANGE(r3, r6);
+	COMPARE_EXCHANGE(r1, r2); COMPARE_EXCHANGE(r3, r4); COMPARE_EXCHANGE(r5, r6);
+
+	// 8x8 transpose
+	t0=_mm256_unpacklo_epi32(r0, r1); t1=_mm256_unpackhi_epi32(r0, r1);
+	t2=_mm256_unpacklo_epi32(r2, r3); t3=_mm256_unpackhi_epi32(r2, r3);
+	t4=_mm256_unpacklo_epi32(r4, r5); t5=_mm256_unpackhi_epi32(r4, r5);
+	t6=_mm256_unpacklo_epi32(r6, r7); t7=_mm256_unpackhi_epi32(r6, r7);
+	r0=_mm256_unpacklo_epi64(t0, t2); r1=_mm256_unpackhi_epi64(t0, t2);
+	r2=_mm256_unpacklo_epi64(t1, t3); r3=_mm256_unpackhi_epi64(t1, t3);
+	r4=_mm256_unpacklo_epi64(t4, t6); r5=_mm256_unpackhi_epi64(t4, t6);
+	r6=_mm256_unpacklo_epi64(t5, t7); r7=_mm256_unpackhi_epi64(t5, t7);
+
+	_mm256_storeu_si256((__m256i*)(vector), _mm256_permute2x128_si256(r0, r4, 0x20));
+	_mm256_storeu_si256((__m256i*)(vector+8), _mm256_permute2x128_si256(r1, r5, 0x20));
+	_mm256_storeu_si256((__m256i*)(vector+16), _mm256_permute2x128_si256(r2, r6, 0x20));
+	_mm256_storeu_si256((__m256i*)(vector+24), _mm256_permute2x128_si256(r3, r7, 0x20));
+	_mm256_storeu_si256((__m256i*)(vector+32), _mm256_permute2x128_si256(r0, r4, 0x31));
+	_mm256_storeu_si256((__m256i*)(vector+40), _mm256_permute2x128_si256(r1, r5, 0x31));
+	_mm256_storeu_si256((__m256i*)(vector+48), _mm256_permute2x128_si256(r2, r6, 0x31));
+	_mm256_storeu_si256((__m256i*)(vector+56), _mm256_permute2x128_si256(r3, r7, 0x31));
+}
+
+// MERGES TWO SORTED VECTORS IN OUT, 8 INTS AT A TIME
+// NOTE: both sizes must be multiples of 8 (and not 0)
+static inline void vectorMerge(const int* a, int sizeA, const int* b, int sizeB, int* out){
+	const int *endA=a+sizeA, *endB=b+sizeB;
+	__m256i low=_mm256_loadu_si256((const __m256i*)a), high=_mm256_loadu_si256((const __m256i*)b);
+	a+=8; b+=8;
+
+	// high always keeps the 8 biggest elements seen so far, low gets the next 8 of the output
+	bitonicMerge16(&low, &high);
+	_mm256_storeu_si256((__m256i*)out, low); out+=8;
+
+	while (a<endA || b<endB){
+		// go on with the vector whose next element is smaller
+		if (b>=endB || (a<endA && *a<=*b)){
+			low=_mm256_loadu_si256((const __m256i*)a); a+=8;
+		}
+		else {
+			low=_mm256_loadu_si256((const __m256i*)b); b+=8;
+		}
+		bitonicMerge16(&low, &high);
+		_mm256_storeu_si256((__m256i*)out, low); out+=8;
+	}
+	_mm256_storeu_si256((__m256i*)out, high);
+}
+
+#undef COMPARE_EXCHANGE
+
+#endif
+
+
+// SORTS THE FIRST SIZE-SIZE%LOCAL_SORT_BLOCK ELEMENTS IN RUNS OF LOCAL_SORT_RUN ELEMENTS (THE LAST ONE CAN BE SHORTER)
+static inline void sortRuns(Element* vector, int size){
+	int start;
+#ifdef LOCAL_SORT_AVX2
+	for (start=0; start+LOCAL_SORT_BLOCK<=size; start+=LOCAL_SORT_BLOCK)
+		sortBlock64(vector+start);
+#else
+	for (start=0; start<size; start+=LOCAL_SORT_RUN)
+		insertionSort(vector+start, (size-start<LOCAL_SORT_RUN) ? size-start : LOCAL_SORT_RUN);
+#endif
+}
+
+// MERGES TWO ADJACENT SORTED RUNS
+static inline void mergeRuns(const Element* a, int sizeA, const Element* b, int sizeB, Element* out){
+	if (sizeB==0)
+		memcpy(out, a, sizeA*sizeof(Element));
+	else
+#ifdef LOCAL_SORT_AVX2
+		vectorMerge(a, sizeA, b, sizeB, out);
+#else
+		scalarMerge(a, sizeA, b, sizeB, out);
+#endif
+}
+
+// SORTING FUNCTION SHARED BY ALL THE PROGRAMS (BOTTOM-UP MERGE SORT)
+static inline void localSort(Element* vector, int size){
+	Element *buffer, *from, *to, *swap;
+	int width, start, sizeA, sizeB;
+
+	if (size<=INSERTION_SORT_LIMIT){
+		insertionSort(vector, size);
+		return;
+	}
+
+	// the head is sorted by the runs and the merges, the tail (shorter than a block) by insertion sort
+	int headSize=size-size%LOCAL_SORT_BLOCK;
+	buffer=(Element*)malloc(sizeof(Element)*size);
+
+	sortRuns(vector, headSize);
+
+	from=vector; to=buffer;
+	for (width=LOCAL_SORT_RUN; width<headSize; width*=2){
+		for (start=0; start<headSize; start+=2*width){
+			sizeA=(headSize-start<width) ? headSize-start : width;
+			sizeB=(headSize-start-sizeA<width) ? headSize-start-sizeA : width;
+			mergeRuns(from+start, sizeA, from+start+sizeA, sizeB, to+start);
+		}
+		swap=from; from=to; to=swap;
+	}
+
+	if (headSize==size){
+		if (from!=vector)
+			memcpy(vector, from, sizeof(Element)*size);
+	}
+
+	// the sorted head goes in the buffer, then it's merged back with the tail
+	// NOTE: merging from the front never overwrites a tail element before reading it
+	else {
+		if (from==vector)
+			memcpy(buffer, vector, sizeof(Element)*headSize);
+		insertionSort(vector+headSize, size-headSize);
+		scalarMerge(buffer, headSize, vector+headSize, size-headSize, vector);
+	}
+
+	free(buffer);
+}
+
+
+// MERGES TWO SORTED VECTORS, WRITING ONLY THE OUTSIZE SMALLEST ELEMENTS IN OUT (A IS THE LOWER NODE'S ONE)
+static inline void mergeLow(Element* a, int sizeA, Element* b, int sizeB, Element* out, int outSize){
+	int i=0, j=0, k;
+	for (k=0; k<outSize; k++)
+		if (j>=sizeB || (i<sizeA && !ELEMENT_LESS(b[j], a[i])))
+			out[k]=a[i++];
+		else
+			out[k]=b[j++];
+}
+
+// MERGES TWO SORTED VECTORS, WRITING ONLY THE OUTSIZE BIGGEST ELEMENTS IN OUT (A IS THE UPPER NODE'S ONE)
+static inline void mergeHigh(Element* a, int sizeA, Element* b, int sizeB, Element* out, int outSize){
+	int i=sizeA-1, j=sizeB-1, k;
+	for (k=outSize-1; k>=0; k--)
+		if (j<0 || (i>=0 && !ELEMENT_LESS(a[i], b[j])))
+			out[k]=a[i--];
+		else
+			out[k]=b[j--];
+}
+
+// RETURNS THE POSITION OF THE FIRST ELEMENT NOT SMALLER THAN KEY IN A SORTED VECTOR (SIZE IF THERE ISN'T ANY)
+static inline int lowerBound(Element* vector, int size, Element key){
+	int low=0, high=size, middle;
+	while (low<high){
+		middle=low+(high-low)/2;
+		if (ELEMENT_LESS(vector[middle], key))
+			low=middle+1;
+		else
+			high=middle;
+	}
+	return low;
+}
+
+// RETURNS THE POSITION OF THE FIRST ELEMENT BIGGER THAN KEY IN A SORTED VECTOR (SIZE IF THERE ISN'T ANY)
+static inline int upperBound(Element* vector, int size, Element key){
+	int low=0, high=size, middle;
+	while (low<high){
+		middle=low+(high-low)/2;
+		if (!ELEMENT_LESS(key, vector[middle]))
+			low=middle+1;
+		else
+			high=middle;
+	}
+	return low;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Strong-scaling benchmark of MatrixMatrixProduct.c: 1D ring against 2D grid (SUMMA) on the same product
+#
+# USAGE: ./MatrixBenchmark.sh [size] [listOfProcesses] [threadsPerProcess]
+# default: 1024 x 1024 matrices on 1, 4, 9 and 16 processes, with a thread each
+# (hybrid runs: e.g. ./MatrixBenchmark.sh 4096 "1 2 4" 16 for 1, 2 and 4 processes of 16 threads)
+#
+# Two random size x size matrices of doubles are written with perl, and both algorithms multiply them with any number of processes:
+# the programs print the time spent in the multiplication phase only (file I/O excluded).
+# The processes are not bound to a core (--bind-to none), so that their threads can spread over the node.
+# Everything runs in a temporary directory, which is removed at the end.
+#
+
+SIZE=${1:-1024}
+PROCESSES=${2:-"1 4 9 16"}
+export OMP_NUM_THREADS=${3:-1}
+SOURCES=$(cd "$(dirname "$0")" && pwd)
+WORKDIR=$(mktemp -d)
+
+mpicc -O2 -march=native -fopenmp -o "$WORKDIR/MatrixMatrixProduct" "$SOURCES/MatrixMatrixProduct.c" -lm || exit 1
+
+cd "$WORKDIR" || exit 1
+for matrix in A B; do
+	perl -e 'srand(1); for (1..$ARGV[0]) { print pack("d*", map { rand() } 1..$ARGV[0]) }' "$SIZE" > "$matrix.bin"
+done
+
+echo "multiplying two $SIZE x $SIZE matrices, $OMP_NUM_THREADS threads per process"
+for processes in $PROCESSES; do
+	for algorithm in ring summa; do
+		mpirun --oversubscribe --bind-to none -np "$processes" ./MatrixMatrixProduct A.bin B.bin "$SIZE" "$SIZE" "$SIZE" C.bin "$algorithm" | grep "multiplication time"
+	done
+done
+
+rm -rf "$WORKDIR"
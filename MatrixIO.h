@@ -0,0 +1,59 @@
+/*
+ * Output files of the matrix programs (MatrixMatrixProduct.c, MatrixVectorProduct.c, SparseMatrixVectorProduct.c, KronecherProduct.c)
+ *
+ * openOutputFile(comm, path, size) opens an output file collectively, and sets it to its final size in bytes
+ * writeProducts(path, products, n, k, startingRow, rows) writes the rows of the k products y=Ax of a process
+ * (rows x k, by rows) at once, as the columns startingRow.. of a k x n matrix (by rows): the k vectors y one after another
+ *
+ * NOTE: header only, so that each program is still compiled from its own single source file
+ *
+ */
+
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "MatrixKernel.h"
+
+// OPENS THE OUTPUT FILE ON ALL THE PROCESSES OF COMM (CREATING IT IF MISSING), OR ABORTS
+// the size drops what an older (and longer) output file left there
+static inline MPI_File openOutputFile(MPI_Comm comm, const char* path, MPI_Offset size){
+	MPI_File handle;
+	int id;
+
+	MPI_Comm_rank(comm, &id);
+	if (MPI_File_open(comm, path, MPI_MODE_WRONLY|MPI_MODE_CREATE, MPI_INFO_NULL, &handle)!=MPI_SUCCESS){
+		if (id==0)
+			printf("Error while opening the output file %s\n", path);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	MPI_File_set_size(handle, size);
+	return handle;
+}
+
+// EVERY PROCESS WRITES ITS ROWS OF THE K PRODUCTS AT ONCE, WITH A SUBARRAY VIEW
+static inline void writeProducts(const char* path, const double* products, int sizeA, int numberOfVectors, int startingRow, int rows){
+	int sizes[2]={numberOfVectors, sizeA}, subsizes[2]={numberOfVectors, rows}, starts[2]={0, startingRow};
+	double *byVector=(double*)malloc(sizeof(double)*((long)rows*numberOfVectors+1));
+	MPI_Datatype view=MPI_DOUBLE;
+	MPI_File outputHandle=openOutputFile(MPI_COMM_WORLD, path, (MPI_Offset)numberOfVectors*sizeA*sizeof(double));
+
+	// (an empty block writes nothing anyway)
+	if (rows>0){
+		MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &view);
+		MPI_Type_commit(&view);
+	}
+	transpose(rows, numberOfVectors, products, byVector);
+	MPI_File_set_view(outputHandle, 0, MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+	MPI_File_write_all(outputHandle, byVector, rows*numberOfVectors, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&outputHandle);
+
+	if (view!=MPI_DOUBLE)
+		MPI_Type_free(&view);
+	free(byVector);
+}
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * Local matrix multiplication kernel shared by the matrix programs (MatrixMatrixProduct.c, MatrixVectorProduct.c, SparseMatrixVectorProduct.c, KronecherProduct.c)
+ *
+ * multiplyBlock(m, n, k, A, lda, B, ldb, C, ldc) computes C += A*B, where
+ *  - A is m x k, stored by rows (row i starts at A+i*lda)
+ *  - B is k x n, stored by columns (column j starts at B+j*ldb), like the blocks of B sent around the ring
+ *  - C is m x n, stored by rows (row i starts at C+i*ldc)
+ *
+ * The loops are blocked for the caches: a KC x NC panel of B and a MC x KC block of A are packed at a time
+ * (so that they're read contiguously, and the B panel stays in L3 and the A block in L2),
+ * then the micro-kernel computes a MR x NR tile of C in registers, walking KC elements of a row panel of A and of a column panel of B
+ * (MR x NR = 6 x 8 doubles in 12 AVX2 registers with FMA, when __AVX2__ and __FMA__ are defined, e.g. mpicc -march=native;
+ * the portable micro-kernel computes the same tile in plain C)
+ *
+ * matrixVectorRows(rows, columns, A, x, y) computes y = A*x for a block of rows of A (by rows), a dot product per row:
+ * dotProduct(n, a, b) keeps 4 AVX2 accumulators of 4 doubles each (4 partial sums in the portable version)
+ * (for many vectors at once, multiplyBlock with the vectors as the columns of B reads A just once for all of them)
+ *
+ * sparseMatrixVectorRows(rows, rowPointers, columns, values, k, X, Y) computes Y = A*X for a block of rows of a sparse A (CSR)
+ * and k vectors (X and Y by rows, k values per row): with a single vector sparseDotProduct gathers the entries of x with AVX2
+ * (4 at a time, in 2 accumulators), with more vectors each nonzero multiplies a whole row of X
+ *
+ * transpose(rows, columns, in, out) writes the transpose of a matrix stored by rows, tile by tile (e.g. to store B by columns)
+ *
+ * HYBRID MPI+THREADS: compiled with OpenMP (e.g. mpicc -fopenmp), multiplyBlock splits the blocks of rows of A among the threads
+ * (each with its own packed block of A, while the packed panel of B is shared), so a single process per node or socket
+ * can use all of its cores (OMP_NUM_THREADS); without OpenMP the pragmas are ignored and everything runs in the calling thread.
+ * allocateFirstTouch(n) allocates a buffer and touches it with the same static division of the threads, so that on NUMA nodes
+ * its pages are placed in the memory of the socket of the thread that is going to use them
+ *
+ * NOTE: header only, so that each program is still compiled from its own single source file
+ *
+ */
+
+#ifndef MATRIX_KERNEL_H
+#define MATRIX_KERNEL_H
+
+#include <stdlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+#define MATRIX_KERNEL_AVX2
+#include <immintrin.h>
+#endif
+
+// size of the tile of C kept in registers
+#define KERNEL_MR 6
+#define KERNEL_NR 8
+
+// sizes of the packed blocks (override with -DKERNEL_MC=... and so on): MC x KC of A, KC x NC of B
+#ifndef KERNEL_MC
+#define KERNEL_MC 96
+#endif
+#ifndef KERNEL_KC
+#define KERNEL_KC 256
+#endif
+#ifndef KERNEL_NC
+#define KERNEL_NC 2048
+#endif
+
+// side of the square tiles of the transpose
+#define TRANSPOSE_TILE 32
+
+
+// PACKS THE MC X KC BLOCK OF A IN PANELS OF MR ROWS: EACH PANEL IS KC COLUMNS OF MR ELEMENTS (THE MISSING ROWS ARE ZEROS)
+static inline void packA(int mc, int kc, const double* A, int lda, double* packed){
+	int i, kk, r;
+	for (i=0; i<mc; i+=KERNEL_MR)
+		for (kk=0; kk<kc; kk++)
+			for (r=0; r<KERNEL_MR; r++)
+				*packed++=(i+r<mc) ? A[(long)(i+r)*lda+kk] : 0.0;
+}
+
+// PACKS THE KC X NC PANEL OF B IN PANELS OF NR COLUMNS: EACH PANEL IS KC ROWS OF NR ELEMENTS (THE MISSING COLUMNS ARE ZEROS)
+static inline void packB(int kc, int nc, const double* B, int ldb, double* packed){
+	int j, kk, c;
+	for (j=0; j<nc; j+=KERNEL_NR, packed+=(long)kc*KERNEL_NR)
+		for (c=0; c<KERNEL_NR; c++)
+			for (kk=0; kk<kc; kk++)
+				packed[kk*KERNEL_NR+c]=(j+c<nc) ? B[(long)(j+c)*ldb+kk] : 0.0;
+}
+
+// ADDS THE PRODUCT OF A PACKED PANEL OF A (MR ROWS) AND OF A PACKED PANEL OF B (NR COLUMNS) TO THE MR X NR TILE OF C
+// only the first mr rows and nr columns of the tile exist in C
+static inline void microKernel(int kc, const double* a, const double* b, double* C, int ldc, int mr, int nr){
+	double tile[KERNEL_MR*KERNEL_NR];
+	int i, j, kk;
+
+#ifdef MATRIX_KERNEL_AVX2
+	__m256d c00=_mm256_setzero_pd(), c01=_mm256_setzero_pd(), c10=_mm256_setzero_pd(), c11=_mm256_setzero_pd();
+	__m256d c20=_mm256_setzero_pd(), c21=_mm256_setzero_pd(), c30=_mm256_setzero_pd(), c31=_mm256_setzero_pd();
+	__m256d c40=_mm256_setzero_pd(), c41=_mm256_setzero_pd(), c50=_mm256_setzero_pd(), c51=_mm256_setzero_pd();
+	__m256d b0, b1, ai;
+
+	for (kk=0; kk<kc; kk++, a+=KERNEL_MR, b+=KERNEL_NR){
+		b0=_mm256_loadu_pd(b); b1=_mm256_loadu_pd(b+4);
+		ai=_mm256_broadcast_sd(a);   c00=_mm256_fmadd_pd(ai, b0, c00); c01=_mm256_fmadd_pd(ai, b1, c01);
+		ai=_mm256_broadcast_sd(a+1); c10=_mm256_fmadd_pd(ai, b0, c10); c11=_mm256_fmadd_pd(ai, b1, c11);
+		ai=_mm256_broadcast_sd(a+2); c20=_mm256_fmadd_pd(ai, b0, c20); c21=_mm256_fmadd_pd(ai, b1, c21);
+		ai=_mm256_broadcast_sd(a+3); c30=_mm256_fmadd_pd(ai, b0, c30); c31=_mm256_fmadd_pd(ai, b1, c31);
+		ai=_mm256_broadcast_sd(a+4); c40=_mm256_fmadd_pd(ai, b0, c40); c41=_mm256_fmadd_pd(ai, b1, c41);
+		ai=_mm256_broadcast_sd(a+5); c50=_mm256_fmadd_pd(ai, b0, c50); c51=_mm256_fmadd_pd(ai, b1, c51);
+	}
+
+	_mm256_storeu_pd(tile, c00);    _mm256_storeu_pd(tile+4, c01);
+	_mm256_storeu_pd(tile+8, c10);  _mm256_storeu_pd(tile+12, c11);
+	_mm256_storeu_pd(tile+16, c20); _mm256_storeu_pd(tile+20, c21);
+	_mm256_storeu_pd(tile+24, c30); _mm256_storeu_pd(tile+28, c31);
+	_mm256_storeu_pd(tile+32, c40); _mm256_storeu_pd(tile+36, c41);
+	_mm256_storeu_pd(tile+40, c50); _mm256_storeu_pd(tile+44, c51);
+#else
+	for (i=0; i<KERNEL_MR*KERNEL_NR; i++)
+		tile[i]=0.0;
+	for (kk=0; kk<kc; kk++, a+=KERNEL_MR, b+=KERNEL_NR)
+		for (i=0; i<KERNEL_MR; i++)
+			for (j=0; j<KERNEL_NR; j++)
+				tile[i*KERNEL_NR+j]+=a[i]*b[j];
+#endif
+
+	for (i=0; i<mr; i++)
+		for (j=0; j<nr; j++)
+			C[(long)i*ldc+j]+=tile[i*KERNEL_NR+j];
+}
+
+// WRITES IN OUT THE TRANSPOSE OF THE ROWS X COLUMNS MATRIX IN (BY ROWS), ONE TILE AT A TIME
+// NOTE: a tile of both matrices fits in L1, so both of them are read and written a cache line at a time
+static inline void transpose(int rows, int columns, const double* in, double* out){
+	int i, j, ii, jj;
+	for (i=0; i<rows; i+=TRANSPOSE_TILE)
+		for (j=0; j<columns; j+=TRANSPOSE_TILE)
+			for (ii=i; ii<rows && ii<i+TRANSPOSE_TILE; ii++)
+				for (jj=j; jj<columns && jj<j+TRANSPOSE_TILE; jj++)
+					out[(long)jj*rows+ii]=in[(long)ii*columns+jj];
+}
+
+// DOT PRODUCT OF A AND B (N DOUBLES EACH)
+// NOTE: independent accumulators hide the latency of the additions, and the loads are streamed (A is read just once)
+static inline double dotProduct(int n, const double* a, const double* b){
+	double sum;
+	int i=0;
+
+#ifdef MATRIX_KERNEL_AVX2
+	__m256d s0=_mm256_setzero_pd(), s1=_mm256_setzero_pd(), s2=_mm256_setzero_pd(), s3=_mm256_setzero_pd();
+	double partial[4];
+
+	for (; i+16<=n; i+=16){
+		s0=_mm256_fmadd_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i), s0);
+		s1=_mm256_fmadd_pd(_mm256_loadu_pd(a+i+4), _mm256_loadu_pd(b+i+4), s1);
+		s2=_mm256_fmadd_pd(_mm256_loadu_pd(a+i+8), _mm256_loadu_pd(b+i+8), s2);
+		s3=_mm256_fmadd_pd(_mm256_loadu_pd(a+i+12), _mm256_loadu_pd(b+i+12), s3);
+	}
+	_mm256_storeu_pd(partial, _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+	sum=(partial[0]+partial[1])+(partial[2]+partial[3]);
+#else
+	double s0=0.0, s1=0.0, s2=0.0, s3=0.0;
+
+	for (; i+4<=n; i+=4){
+		s0+=a[i]*b[i];
+		s1+=a[i+1]*b[i+1];
+		s2+=a[i+2]*b[i+2];
+		s3+=a[i+3]*b[i+3];
+	}
+	sum=(s0+s1)+(s2+s3);
+#endif
+
+	for (; i<n; i++)
+		sum+=a[i]*b[i];
+	return sum;
+}
+
+// Y = A (ROWS X COLUMNS, BY ROWS) * X
+// with OpenMP each thread takes a block of rows
+static inline void matrixVectorRows(int rows, int columns, const double* A, const double* x, double* y){
+	int i;
+	#pragma omp parallel for schedule(static)
+	for (i=0; i<rows; i++)
+		y[i]=dotProduct(columns, A+(long)i*columns, x);
+}
+
+// DOT PRODUCT OF THE N NONZEROS (VALUES, COLUMNS) OF A SPARSE ROW AND X
+static inline double sparseDotProduct(long n, const int* columns, const double* values, const double* x){
+	double sum;
+	long i=0;
+
+#ifdef MATRIX_KERNEL_AVX2
+	__m256d s0=_mm256_setzero_pd(), s1=_mm256_setzero_pd();
+	double partial[4];
+
+	for (; i+8<=n; i+=8){
+		s0=_mm256_fmadd_pd(_mm256_loadu_pd(values+i), _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)(columns+i)), 8), s0);
+		s1=_mm256_fmadd_pd(_mm256_loadu_pd(values+i+4), _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)(columns+i+4)), 8), s1);
+	}
+	_mm256_storeu_pd(partial, _mm256_add_pd(s0, s1));
+	sum=(partial[0]+partial[1])+(partial[2]+partial[3]);
+#else
+	double s0=0.0, s1=0.0, s2=0.0, s3=0.0;
+
+	for (; i+4<=n; i+=4){
+		s0+=values[i]*x[columns[i]];
+		s1+=values[i+1]*x[columns[i+1]];
+		s2+=values[i+2]*x[columns[i+2]];
+		s3+=values[i+3]*x[columns[i+3]];
+	}
+	sum=(s0+s1)+(s2+s3);
+#endif
+
+	for (; i<n; i++)
+		sum+=values[i]*x[columns[i]];
+	return sum;
+}
+
+// Y (ROWS X K) = A (ROWS OF A SPARSE MATRIX: ROW I IS NONZEROS ROWPOINTERS[I]..ROWPOINTERS[I+1]-1) * X (K VALUES PER COLUMN OF A)
+// with OpenMP the threads take chunks of rows dynamically, since the rows can have very different numbers of nonzeros
+static inline void sparseMatrixVectorRows(int rows, const long long* rowPointers, const int* columns, const double* values,
+		int k, const double* X, double* Y){
+	int i, j;
+	long long p;
+
+	#pragma omp parallel for schedule(dynamic, 64) private(j, p)
+	for (i=0; i<rows; i++){
+		if (k==1)
+			Y[i]=sparseDotProduct(rowPointers[i+1]-rowPointers[i], columns+rowPointers[i], values+rowPointers[i], X);
+		else {
+			double *y=Y+(long)i*k;
+			for (j=0; j<k; j++)
+				y[j]=0.0;
+			for (p=rowPointers[i]; p<rowPointers[i+1]; p++)
+				for (j=0; j<k; j++)
+					y[j]+=values[p]*X[(long)columns[p]*k+j];
+		}
+	}
+}
+
+// NUMBER OF THREADS THE KERNELS RUN ON (1 WITHOUT OPENMP)
+static inline int kernelThreads(void){
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// ALLOCATES N DOUBLES (SET TO ZERO) AND TOUCHES THEM FIRST FROM THE THREADS, WITH THE STATIC DIVISION OF THE LOOPS OVER THE ROWS
+// NOTE: a page is placed on the NUMA node of the thread that writes it first, so a buffer filled later by the master thread
+// (fread, MPI receives) still lives where it's going to be used
+static inline double* allocateFirstTouch(long n){
+	double *buffer=(double*)malloc(sizeof(double)*(n>0 ? n : 1));
+	long i;
+	#pragma omp parallel for schedule(static)
+	for (i=0; i<n; i++)
+		buffer[i]=0.0;
+	return buffer;
+}
+
+// C (M X N, BY ROWS) += A (M X K, BY ROWS) * B (K X N, BY COLUMNS)
+// with OpenMP the threads pack the panel of B together, then each of them takes some blocks of rows of A
+static inline void multiplyBlock(int m, int n, int k, const double* A, int lda, const double* B, int ldb, double* C, int ldc){
+	int nc, kc, mcStep;
+
+	if (m<=0 || n<=0 || k<=0)
+		return;
+
+	// the packed blocks are never bigger than the matrices (rounded up to whole panels),
+	// and the rows are divided in blocks small enough to keep all the threads busy
+	mcStep=(m+kernelThreads()-1)/kernelThreads();
+	mcStep=(mcStep+KERNEL_MR-1)/KERNEL_MR*KERNEL_MR;
+	if (mcStep>KERNEL_MC)
+		mcStep=KERNEL_MC;
+	nc=(n<KERNEL_NC) ? n : KERNEL_NC;
+	kc=(k<KERNEL_KC) ? k : KERNEL_KC;
+	double *packedB=(double*)malloc(sizeof(double)*((nc+KERNEL_NR-1)/KERNEL_NR*KERNEL_NR)*kc);
+
+	#pragma omp parallel
+	{
+		int jc, pc, ic, jr, ir, ncBlock, kcBlock, mc;
+		double *packedA=(double*)malloc(sizeof(double)*((mcStep+KERNEL_MR-1)/KERNEL_MR*KERNEL_MR)*kc);
+
+		for (jc=0; jc<n; jc+=KERNEL_NC){
+			ncBlock=(n-jc<KERNEL_NC) ? n-jc : KERNEL_NC;
+
+			for (pc=0; pc<k; pc+=KERNEL_KC){
+				kcBlock=(k-pc<KERNEL_KC) ? k-pc : KERNEL_KC;
+
+				// each thread packs some panels of NR columns (the implicit barrier waits for the whole panel of B)
+				#pragma omp for schedule(static)
+				for (jr=0; jr<ncBlock; jr+=KERNEL_NR)
+					packB(kcBlock, (ncBlock-jr<KERNEL_NR) ? ncBlock-jr : KERNEL_NR, B+(long)(jc+jr)*ldb+pc, ldb, packedB+(long)jr*kcBlock);
+
+				// and multiplies its own blocks of rows of A by it (the panel of B is packed again only when everybody is done)
+				#pragma omp for schedule(static)
+				for (ic=0; ic<m; ic+=mcStep){
+					mc=(m-ic<mcStep) ? m-ic : mcStep;
+					packA(mc, kcBlock, A+(long)ic*lda+pc, lda, packedA);
+
+					for (jr=0; jr<ncBlock; jr+=KERNEL_NR)
+						for (ir=0; ir<mc; ir+=KERNEL_MR)
+							microKernel(kcBlock, packedA+(long)ir*kcBlock, packedB+(long)jr*kcBlock, C+(long)(ic+ir)*ldc+jc+jr, ldc,
+									(mc-ir<KERNEL_MR) ? mc-ir : KERNEL_MR, (ncBlock-jr<KERNEL_NR) ? ncBlock-jr : KERNEL_NR);
+				}
+			}
+		}
+
+		free(packedA);
+	}
+
+	free(packedB);
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Benchmark of the blocked matrix multiplication kernel (MatrixKernel.h) against the naive loop of MatrixMatrixProduct.c
+ *
+ * USAGE: ./MatrixKernelBenchmark [m k n]
+ * default: some square and skinny shapes (C is m x n, A is m x k, B is k x n stored by columns, like a block of the ring)
+ *
+ * For each shape it prints the GFLOP/s of both kernels (best of REPETITIONS runs) and the biggest difference between their results
+ * compile with: mpicc -O2 -march=native -o MatrixKernelBenchmark MatrixKernelBenchmark.c -lm, and run it on a single process
+ * (add -fopenmp to time the blocked kernel on OMP_NUM_THREADS threads, against the naive loop on one)
+ *
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "MatrixKernel.h"
+
+// runs of each kernel on each shape (override with -DREPETITIONS=...)
+#ifndef REPETITIONS
+#define REPETITIONS 3
+#endif
+
+void naiveProduct(int, int, int, const double*, const double*, double*);
+void benchmark(int, int, int);
+
+int main(int argc, char **argv){
+	int shapes[][3]={
+		{512, 512, 512}, {1024, 1024, 1024},		// square
+		{2048, 2048, 16}, {2048, 2048, 64},		// few columns of B: a block of the ring with many processes
+		{16, 2048, 2048}, {2048, 16, 2048}		// few rows of A, short inner dimension
+	};
+	int i;
+
+	MPI_Init(&argc, &argv);
+
+#ifdef MATRIX_KERNEL_AVX2
+	printf("blocked kernel: AVX2/FMA micro-kernel %dx%d, %d threads\n", KERNEL_MR, KERNEL_NR, kernelThreads());
+#else
+	printf("blocked kernel: portable micro-kernel %dx%d, %d threads\n", KERNEL_MR, KERNEL_NR, kernelThreads());
+#endif
+	printf("%6s %6s %6s   %14s %14s %8s %12s\n", "m", "k", "n", "naive GFLOP/s", "blocked GFLOP/s", "speedup", "max diff");
+
+	if (argc==4)
+		benchmark(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+	else
+		for (i=0; i<(int)(sizeof(shapes)/sizeof(shapes[0])); i++)
+			benchmark(shapes[i][0], shapes[i][1], shapes[i][2]);
+
+	MPI_Finalize();
+	return 0;
+}
+
+
+// THE LOOP OF MATRIXMATRIXPRODUCT.C BEFORE THE BLOCKED KERNEL: COLUMN BY COLUMN OF B
+void naiveProduct(int m, int n, int k, const double* A, const double* B, double* C){
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < m; ++j)
+			for (int l = 0; l < k; ++l)
+				C[j * n + i] += A[j * k + l] * B[i * k + l];
+}
+
+// TIMES BOTH KERNELS ON A M X K BY K X N PRODUCT
+void benchmark(int m, int k, int n){
+	double *A=malloc(sizeof(double)*m*k), *B=malloc(sizeof(double)*k*n);
+	double *naiveC=malloc(sizeof(double)*m*n), *blockedC=malloc(sizeof(double)*m*n);
+	double elapsed, naiveTime=1e30, blockedTime=1e30, maxDiff=0.0, flops=2.0*m*n*k;
+	long i;
+	int run;
+
+	for (i=0; i<(long)m*k; i++)
+		A[i]=(double)rand()/RAND_MAX-0.5;
+	for (i=0; i<(long)k*n; i++)
+		B[i]=(double)rand()/RAND_MAX-0.5;
+
+	for (run=0; run<REPETITIONS; run++){
+		memset(naiveC, 0, sizeof(double)*m*n);
+		elapsed=MPI_Wtime();
+		naiveProduct(m, n, k, A, B, naiveC);
+		elapsed=MPI_Wtime()-elapsed;
+		if (elapsed<naiveTime)
+			naiveTime=elapsed;
+
+		memset(blockedC, 0, sizeof(double)*m*n);
+		elapsed=MPI_Wtime();
+		multiplyBlock(m, n, k, A, k, B, k, blockedC, n);
+		elapsed=MPI_Wtime()-elapsed;
+		if (elapsed<blockedTime)
+			blockedTime=elapsed;
+	}
+
+	for (i=0; i<(long)m*n; i++)
+		if (fabs(naiveC[i]-blockedC[i])>maxDiff)
+			maxDiff=fabs(naiveC[i]-blockedC[i]);
+
+	printf("%6d %6d %6d   %14.2f %14.2f %7.1fx %12.2e\n", m, k, n, flops/naiveTime*1e-9, flops/blockedTime*1e-9, naiveTime/blockedTime, maxDiff);
+
+	free(A); free(B); free(naiveC); free(blockedC);
+}
@@ -1,6 +1,16 @@
 /*
  * SHARED FILE-SYSTEM, RAW-STORED MATRICES, MASTER JOINS THE COMPUTATION
  *
+ * ALGORITHMS (optional 7th parameter):
+ *  ring  (default) = each process keeps a panel of rows of A, while the panels of columns of B go around a ring of processes
+ *  summa = 2D grid of processes (as square as possible): each process keeps a block of A, of B and of the result,
+ *          and for each panel of the inner dimension the owners broadcast their part of A along their grid row
+ *          and their part of B along their grid column (SUMMA), so each process moves O(n^2/sqrt(p)) data instead of O(n^2)
+ *
+ * HYBRID MPI+THREADS: compiled with -fopenmp, each process multiplies its blocks with OMP_NUM_THREADS threads (see MatrixKernel.h),
+ * so it can run with a process per node or per socket (e.g. mpirun --map-by socket --bind-to socket) instead of one per core:
+ * B is replicated and the messages are sent once per process, not once per core. Only the master thread calls MPI (MPI_THREAD_FUNNELED)
+ *
  */
 
 #include <mpi.h>
@@ -8,28 +18,77 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "MatrixKernel.h"
+#include "MatrixIO.h"
+
 #define MASTER 0
 
+// doubles in front of each block of B sent around the ring: its starting column and its number of columns
+#define BLOCK_HEADER 2
+
+// 1 = at the end the master reads the whole output file back and prints it (a serial pass, just for test: -DCHECK=1)
+#ifndef CHECK
+#define CHECK 0
+#endif
 
-int main(int argc, char **argv){ // argv1=inputA, argv2=inputB, argv3=Ra, argv4=Ca=Rb, argv5=Cb, argv6=output
+// width of the panels of the inner dimension broadcast by SUMMA (override with -DPANEL_WIDTH=...)
+#ifndef PANEL_WIDTH
+#define PANEL_WIDTH 256
+#endif
+
+int blockStart(int, int, int);
+int blockSize(int, int, int);
+int blockOwner(int, int, int);
+MPI_Datatype subarrayView(int, int, int, int, int, int);
+void summaProduct(char*, char*, char*, int, int, int);
+void printOutput(char*, int, int);
+
+
+int main(int argc, char **argv){ // argv1=inputA, argv2=inputB, argv3=Ra, argv4=Ca=Rb, argv5=Cb, argv6=output, [argv7=ring|summa]
 
 	// Variable declaration
 	int processId, numberOfProcesses;
 	double *chunkMatrixA = NULL; double *chunkMatrixB = NULL; double *result = NULL;
 
-	// MPI initialization
-	MPI_Init(&argc, &argv);
+	// MPI initialization: the threads never call MPI, only the master thread does
+	int threadSupport;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
 	MPI_Comm_rank(MPI_COMM_WORLD, &processId);
 	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
 
+	if (processId==MASTER) {
+		printf("running %d processes x %d threads\n", numberOfProcesses, kernelThreads());
+		if (threadSupport<MPI_THREAD_FUNNELED && kernelThreads()>1)
+			printf("Warning: the MPI library does not support MPI_THREAD_FUNNELED\n");
+	}
+
 	// check input parameters
-	if (argc!=7)
+	if (argc!=7 && argc!=8)
 		if (processId==MASTER) {
 			printf("Error in numer of parameters\n");
 			MPI_Abort(MPI_COMM_WORLD, 0);
 		}
 
 	int rowsA = atoi(argv[3]), columnsA = atoi(argv[4]), rowsB = atoi(argv[4]), columnsB = atoi(argv[5]);
+	double startTime, endTime;
+
+
+	// ************************************************* SUMMA *************************************************
+
+	if (argc==8 && strcmp(argv[7], "summa")==0) {
+		summaProduct(argv[1], argv[2], argv[6], rowsA, columnsA, columnsB);
+
+		if (CHECK && processId==MASTER)
+			printOutput(argv[6], rowsA, columnsB);
+
+		MPI_Finalize();
+		return 0;
+	}
+	else if (argc==8 && strcmp(argv[7], "ring")!=0)
+		if (processId==MASTER) {
+			printf("Unknown algorithm %s (ring or summa)\n", argv[7]);
+			MPI_Abort(MPI_COMM_WORLD, 0);
+		}
 
 
 	// ************************************************* MATRIX A *************************************************
@@ -53,8 +112,8 @@ int main(int argc, char **argv){ // argv1=inputA, argv2=inputB, argv3=Ra, argv4=
 	// considers the rest
 	rowsAPerProcess += (processId<restA) ? 1 : 0;
 
-	// allocates the memory
-	chunkMatrixA = malloc(rowsAPerProcess * columnsA * sizeof(double));
+	// allocates the memory (touched first by the threads that are going to multiply its rows)
+	chunkMatrixA = allocateFirstTouch((long)rowsAPerProcess * columnsA);
 
 	// sets the stream
 	fseek(inputPtrA, startingRow*columnsA*sizeof(double), SEEK_SET);
@@ -68,13 +127,13 @@ int main(int argc, char **argv){ // argv1=inputA, argv2=inputB, argv3=Ra, argv4=
 
 	// ************************************************* MATRIX B *************************************************
 
-	// open the input file containing matrix A
-	FILE *inputPtrB = fopen(argv[2], "rb");
-	if (inputPtrB==NULL)
-		if (processId==MASTER) {
+	// open the input file containing matrix B (all the processes together: they read it with a single collective call)
+	MPI_File inputHandleB;
+	if (MPI_File_open(MPI_COMM_WORLD, argv[2], MPI_MODE_RDONLY, MPI_INFO_NULL, &inputHandleB)!=MPI_SUCCESS) {
+		if (processId==MASTER)
 			printf("Error while opening matrix B\n");
-			MPI_Abort(MPI_COMM_WORLD, 0);
-		}
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
 
 	// each process computes his part of work
 	int columnsBPerProcess = columnsB / numberOfProcesses;
@@ -87,121 +146,249 @@ int main(int argc, char **argv){ // argv1=inputA, argv2=inputB, argv3=Ra, argv4=
 	// considers the rest
 	columnsBPerProcess += (processId<restB) ? 1 : 0;
 
-	// allocates the memory
-	chunkMatrixB = malloc(columnsBPerProcess * rowsB * sizeof(double));
+	// allocates the memory: the block travels around the ring with its own header (starting column and number of columns),
+	// so the buffers are as big as the biggest block, plus the header
+	int maxColumnsBPerProcess = columnsB / numberOfProcesses + ((restB>0) ? 1 : 0);
+	int maxBlockSize = BLOCK_HEADER + maxColumnsBPerProcess * rowsB;
+	double *blockB = malloc(maxBlockSize * sizeof(double));
+	double *nextBlockB = malloc(maxBlockSize * sizeof(double));
+	blockB[0] = startingColumn;
+	blockB[1] = columnsBPerProcess;
+	chunkMatrixB = blockB + BLOCK_HEADER;
 
 
-	for (int i = 0; i < columnsBPerProcess; ++i)
-		for (int j = 0; j < rowsB; ++j) {
-			// sets the stream
-			fseek(inputPtrB, (j * columnsB + startingColumn + i) * sizeof(double), SEEK_SET);
-			// and reads a value
-			fread(&chunkMatrixB[i * rowsB + j], sizeof(double), 1, inputPtrB);
-		}
+	// the file view shows each process just its columns (a rowsB x columnsBPerProcess subarray of the matrix, stored by rows),
+	// so they are read in bulk, and transposed in memory to the layout of the block (by columns)
+	MPI_Datatype columnsPanel = subarrayView(rowsB, columnsB, rowsB, columnsBPerProcess, 0, startingColumn);
+	MPI_File_set_view(inputHandleB, 0, MPI_DOUBLE, columnsPanel, "native", MPI_INFO_NULL);
 
+	double *rowsPanel = malloc((columnsBPerProcess * rowsB + 1) * sizeof(double));
+	MPI_File_read_all(inputHandleB, rowsPanel, columnsBPerProcess * rowsB, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	transpose(rowsB, columnsBPerProcess, rowsPanel, chunkMatrixB);
+	free(rowsPanel);
 
-	// finally closes the input stream
-	fclose(inputPtrB);
+	// finally closes the input file
+	MPI_File_close(&inputHandleB);
+	if (columnsPanel!=MPI_DOUBLE)
+		MPI_Type_free(&columnsPanel);
 
 
 	// ************************************************* MATRICES MULTIPLICATION *************************************************
 
-	int vectorBSize = columnsBPerProcess*rowsB, vectorASize = rowsAPerProcess*columnsA, receiveFrom=processId;
-	int lastUsedAPos=0;
+	int sendTo = (processId+1)%numberOfProcesses;
+	int receiveFrom = (processId==MASTER) ? numberOfProcesses-1 : processId-1;
+	MPI_Request requests[2];
+	double *swap;
 
-	// allocate the memory for the final result vector
-	result = malloc(rowsAPerProcess * columnsB * sizeof(double));
-	memset(result, 0, rowsAPerProcess * columnsB * sizeof(double));
+	// allocate the memory for the final result vector (already zero, and touched first by the threads that compute its rows)
+	result = allocateFirstTouch((long)rowsAPerProcess * columnsB);
 
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime = MPI_Wtime();
 
 	for (int globalIterator = 0; globalIterator < numberOfProcesses; ++globalIterator) {
 
-		for (int i = 0; i < columnsBPerProcess; ++i)
-			for (int j = 0; j < rowsAPerProcess; ++j)
-				for (int k = 0; k < rowsB; ++k)
-					result[j * columnsB + i + startingColumn] += chunkMatrixA[j * columnsA + k] * chunkMatrixB[i * rowsB + k];
-
-		// send data to the next process
-		MPI_Send(&startingColumn, 1, MPI_INT, (processId+1)%numberOfProcesses, 0, MPI_COMM_WORLD);
-		MPI_Send(&columnsBPerProcess, 1, MPI_INT, (processId+1)%numberOfProcesses, 1, MPI_COMM_WORLD);
-		MPI_Send(chunkMatrixB, vectorBSize, MPI_DOUBLE, (processId+1)%numberOfProcesses, 2, MPI_COMM_WORLD);
-
-		// receive data from the previous one
-		receiveFrom = (processId==MASTER) ? numberOfProcesses-1 : processId-1;
-		MPI_Recv(&startingColumn, 1, MPI_INT, receiveFrom, 0, MPI_COMM_WORLD, NULL);
-		MPI_Recv(&columnsBPerProcess, 1, MPI_INT, receiveFrom, 1, MPI_COMM_WORLD, NULL);
-		vectorBSize = columnsBPerProcess * rowsB;
-		chunkMatrixB = realloc(chunkMatrixB, columnsBPerProcess * rowsB * sizeof(double));
-		MPI_Recv(chunkMatrixB, vectorBSize, MPI_DOUBLE, receiveFrom, 2, MPI_COMM_WORLD, NULL);
+		// the block goes on to the next process, while the one of the previous process arrives (all but the last iteration)
+		// NOTE: the block being sent is only read by the multiplication
+		if (globalIterator < numberOfProcesses-1) {
+			MPI_Irecv(nextBlockB, maxBlockSize, MPI_DOUBLE, receiveFrom, 2, MPI_COMM_WORLD, &requests[0]);
+			MPI_Isend(blockB, BLOCK_HEADER + columnsBPerProcess*rowsB, MPI_DOUBLE, sendTo, 2, MPI_COMM_WORLD, &requests[1]);
+		}
+
+		// multiply our rows of A by the columns of B in the block, adding to the same columns of the result
+		multiplyBlock(rowsAPerProcess, columnsBPerProcess, rowsB, chunkMatrixA, columnsA, chunkMatrixB, rowsB,
+				result + startingColumn, columnsB);
+
+		// switch to the block just arrived
+		if (globalIterator < numberOfProcesses-1) {
+			MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+			swap = blockB; blockB = nextBlockB; nextBlockB = swap;
+			startingColumn = (int)blockB[0];
+			columnsBPerProcess = (int)blockB[1];
+			chunkMatrixB = blockB + BLOCK_HEADER;
+		}
 	}
 
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime = MPI_Wtime();
+	if (processId==MASTER)
+		printf("multiplication time with %d processes (ring): %f s\n", numberOfProcesses, endTime-startTime);
+
 
 	// ************************************************* WRITE OUTPUT FILE *************************************************
 
-	FILE *outputPtr;
+	// every process already knows where its rows go: everybody writes its panel of rows at once
+	MPI_File outputHandle = openOutputFile(MPI_COMM_WORLD, argv[6], (MPI_Offset)rowsA * columnsB * sizeof(double));
+	MPI_File_write_at_all(outputHandle, (MPI_Offset)startingRow * columnsB * sizeof(double), result, rowsAPerProcess * columnsB, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&outputHandle);
 
-	// MASTER'S WORK
-	if (processId==MASTER){
-		// open the output file
-		outputPtr = fopen(argv[6], "wb");
-		if (outputPtr==NULL) {
-			printf("Error while opening the output file\n");
-			MPI_Abort(MPI_COMM_WORLD, 0);
-			return 1;
-		}
 
-		// write data and close the file
-		fwrite(result, sizeof(double), columnsB*rowsAPerProcess, outputPtr);
-		fclose(outputPtr);
 
-		// send a signal to other processes
-		int discard;
-		for (int i = 1; i < numberOfProcesses; ++i) {
-			MPI_Send(&i, 1, MPI_INT, i, 100, MPI_COMM_WORLD);
-			MPI_Recv(&discard, 1, MPI_INT, i, 101, MPI_COMM_WORLD, NULL);
-		}
-	}
+	// ************************************************* CHECK *************************************************
 
-	// SLAVES' WORK
-	else {
-		int i = 0;
-		// receive signal from master
-		MPI_Recv(&i, 1, MPI_INT, MASTER, 100, MPI_COMM_WORLD, NULL);
-		// append the output file
-		outputPtr = fopen(argv[6], "ab");
-		if (outputPtr==NULL) {
-			printf("Error while opening the output file\n");
-			MPI_Abort(MPI_COMM_WORLD, 0);
-			return 1;
-		}
+	if (CHECK && processId==MASTER)
+		printOutput(argv[6], rowsA, columnsB);
 
-		// write data
-		fwrite(result, sizeof(double), columnsB*rowsAPerProcess, outputPtr);
-		fclose(outputPtr);
 
-		// send back a termination signal
-		MPI_Send(&i, 1, MPI_INT, MASTER, 101, MPI_COMM_WORLD);
-	}
+	free(chunkMatrixA); free(blockB); free(nextBlockB); free(result);
+
+	MPI_Finalize();
+	return 0;
+}
 
 
 
-	// ************************************************* CHECK *************************************************
 
-	if (processId==MASTER){
-		double val;
-		outputPtr = fopen(argv[6], "rb");
-		for (int i = 0; i < columnsB*rowsA; ++i){
-			fread(&val, 1, sizeof(double), outputPtr);
-			printf("%f ", val);
-			if ((i+1)%columnsB==0)
-				printf("\n");
+// first element of part id, when n elements are divided in parts parts (the first n%parts parts get one more element)
+int blockStart(int id, int parts, int n){
+	return id * (n / parts) + ((id < n % parts) ? id : n % parts);
+}
+
+// number of elements of part id
+int blockSize(int id, int parts, int n){
+	return n / parts + ((id < n % parts) ? 1 : 0);
+}
+
+// part the index-th element belongs to
+int blockOwner(int index, int parts, int n){
+	int size = n / parts, rest = n % parts;
+	if (index < rest * (size+1))
+		return index / (size+1);
+	return rest + (index - rest * (size+1)) / size;
+}
+
+// file view of the subRows x subColumns block starting at (startRow, startColumn) of a rows x columns matrix of doubles stored by rows
+// (just MPI_DOUBLE for an empty block, which reads or writes nothing anyway)
+MPI_Datatype subarrayView(int rows, int columns, int subRows, int subColumns, int startRow, int startColumn){
+	MPI_Datatype view = MPI_DOUBLE;
+	if (subRows>0 && subColumns>0) {
+		int sizes[2] = {rows, columns}, subsizes[2] = {subRows, subColumns}, starts[2] = {startRow, startColumn};
+		MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &view);
+		MPI_Type_commit(&view);
+	}
+	return view;
+}
+
+// C = A * B ON A 2D GRID OF PROCESSES (SUMMA)
+// process (r, c) reads the block (r, c) of A and of B (the inner dimension is divided among the grid columns for A and among the grid rows for B)
+// and computes the block (r, c) of C, adding the product of a panel of A (from its grid row) and a panel of B (from its grid column) at a time
+void summaProduct(char *pathA, char *pathB, char *pathC, int rowsA, int columnsA, int columnsB){
+	int processId, numberOfProcesses, dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+	MPI_Comm gridComm, rowComm, columnComm;
+	MPI_File fileHandle;
+	MPI_Datatype view;
+	double startTime, endTime;
+
+	// the grid, and a communicator for each grid row and for each grid column (ranked by grid column and by grid row)
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+	MPI_Dims_create(numberOfProcesses, 2, dims);
+	MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &gridComm);
+	MPI_Comm_rank(gridComm, &processId);
+	MPI_Cart_coords(gridComm, processId, 2, coords);
+	MPI_Comm_split(gridComm, coords[0], coords[1], &rowComm);
+	MPI_Comm_split(gridComm, coords[1], coords[0], &columnComm);
+
+	int rows = blockSize(coords[0], dims[0], rowsA), firstRow = blockStart(coords[0], dims[0], rowsA);
+	int columns = blockSize(coords[1], dims[1], columnsB), firstColumn = blockStart(coords[1], dims[1], columnsB);
+	int innerA = blockSize(coords[1], dims[1], columnsA), firstInnerA = blockStart(coords[1], dims[1], columnsA);
+	int innerB = blockSize(coords[0], dims[0], columnsA), firstInnerB = blockStart(coords[0], dims[0], columnsA);
+
+	// the rows of A, of its panels and of C are touched first by the threads that are going to work on them
+	double *blockA = allocateFirstTouch((long)rows * innerA);
+	double *rowsB = malloc((innerB * columns + 1) * sizeof(double));
+	double *blockB = malloc((innerB * columns + 1) * sizeof(double));
+	double *blockC = allocateFirstTouch((long)rows * columns);
+	double *panelA = allocateFirstTouch((long)rows * PANEL_WIDTH);
+	double *panelB = malloc((PANEL_WIDTH * columns + 1) * sizeof(double));
+
+	// read the block of A (by rows) and the block of B (by rows, then transposed to columns like the blocks of the ring)
+	if (MPI_File_open(gridComm, pathA, MPI_MODE_RDONLY, MPI_INFO_NULL, &fileHandle)!=MPI_SUCCESS) {
+		if (processId==MASTER)
+			printf("Error while opening matrix A\n");
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	view = subarrayView(rowsA, columnsA, rows, innerA, firstRow, firstInnerA);
+	MPI_File_set_view(fileHandle, 0, MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+	MPI_File_read_all(fileHandle, blockA, rows * innerA, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&fileHandle);
+	if (view!=MPI_DOUBLE)
+		MPI_Type_free(&view);
+
+	if (MPI_File_open(gridComm, pathB, MPI_MODE_RDONLY, MPI_INFO_NULL, &fileHandle)!=MPI_SUCCESS) {
+		if (processId==MASTER)
+			printf("Error while opening matrix B\n");
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	view = subarrayView(columnsA, columnsB, innerB, columns, firstInnerB, firstColumn);
+	MPI_File_set_view(fileHandle, 0, MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+	MPI_File_read_all(fileHandle, rowsB, innerB * columns, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&fileHandle);
+	if (view!=MPI_DOUBLE)
+		MPI_Type_free(&view);
+	transpose(innerB, columns, rowsB, blockB);
+	free(rowsB);
+
+
+	MPI_Barrier(gridComm);
+	startTime = MPI_Wtime();
+
+	// a panel never crosses the border between the parts of two grid columns (for A) or of two grid rows (for B),
+	// so it comes from a single process of the grid row and of the grid column
+	int ownerA, ownerB, width;
+	for (int k = 0; k < columnsA; k += width) {
+		ownerA = blockOwner(k, dims[1], columnsA);
+		ownerB = blockOwner(k, dims[0], columnsA);
+		width = PANEL_WIDTH;
+		if (blockStart(ownerA, dims[1], columnsA) + blockSize(ownerA, dims[1], columnsA) - k < width)
+			width = blockStart(ownerA, dims[1], columnsA) + blockSize(ownerA, dims[1], columnsA) - k;
+		if (blockStart(ownerB, dims[0], columnsA) + blockSize(ownerB, dims[0], columnsA) - k < width)
+			width = blockStart(ownerB, dims[0], columnsA) + blockSize(ownerB, dims[0], columnsA) - k;
+
+		// the owner packs the columns k..k+width of its block of A (rows x width, by rows) and sends them along the grid row
+		if (coords[1]==ownerA) {
+			#pragma omp parallel for schedule(static)
+			for (int i = 0; i < rows; ++i)
+				memcpy(&panelA[i * width], &blockA[i * innerA + k - firstInnerA], width * sizeof(double));
 		}
-		fclose(outputPtr);
+		MPI_Bcast(panelA, rows * width, MPI_DOUBLE, ownerA, rowComm);
+
+		// the owner packs the rows k..k+width of its block of B (width x columns, by columns) and sends them along the grid column
+		if (coords[0]==ownerB)
+			for (int j = 0; j < columns; ++j)
+				memcpy(&panelB[j * width], &blockB[j * innerB + k - firstInnerB], width * sizeof(double));
+		MPI_Bcast(panelB, width * columns, MPI_DOUBLE, ownerB, columnComm);
+
+		multiplyBlock(rows, columns, width, panelA, width, panelB, width, blockC, columns);
 	}
 
+	MPI_Barrier(gridComm);
+	endTime = MPI_Wtime();
+	if (processId==MASTER)
+		printf("multiplication time with %d processes (summa, %dx%d grid): %f s\n", numberOfProcesses, dims[0], dims[1], endTime-startTime);
 
-	free(chunkMatrixA); free(chunkMatrixB); free(result);
 
-	MPI_Finalize();
-	return 0;
+	// everybody writes its block of C at once
+	fileHandle = openOutputFile(gridComm, pathC, (MPI_Offset)rowsA * columnsB * sizeof(double));
+	view = subarrayView(rowsA, columnsB, rows, columns, firstRow, firstColumn);
+	MPI_File_set_view(fileHandle, 0, MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+	MPI_File_write_all(fileHandle, blockC, rows * columns, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&fileHandle);
+	if (view!=MPI_DOUBLE)
+		MPI_Type_free(&view);
+
+	free(blockA); free(blockB); free(blockC); free(panelA); free(panelB);
+	MPI_Comm_free(&rowComm); MPI_Comm_free(&columnComm); MPI_Comm_free(&gridComm);
+}
+
+// prints the rows x columns matrix of the output file (just for test)
+void printOutput(char *path, int rows, int columns){
+	double val;
+	FILE *outputPtr = fopen(path, "rb");
+	for (int i = 0; i < columns*rows; ++i){
+		fread(&val, 1, sizeof(double), outputPtr);
+		printf("%f ", val);
+		if ((i+1)%columns==0)
+			printf("\n");
+	}
+	fclose(outputPtr);
 }
@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Benchmark of the exact summation of MatrixVectorProduct.c against the plain one, on the same input
+#
+# USAGE: ./MatrixVectorBenchmark.sh [size] [listOfProcesses] [vectors]
+# default: a 4096 x 4096 matrix and 16 vectors on 1, 2, 3, 4 and 8 processes
+#
+# A random input is written by the program itself (-r), then both summations compute the quadratic forms with each number of processes:
+# the programs print their time (I/O included) and the first result with all of its digits,
+# which changes with the number of processes in the plain summation and never in the exact one.
+# Everything runs in a temporary directory, which is removed at the end.
+#
+
+SIZE=${1:-4096}
+PROCESSES=${2:-"1 2 3 4 8"}
+VECTORS=${3:-16}
+SOURCES=$(cd "$(dirname "$0")" && pwd)
+WORKDIR=$(mktemp -d)
+
+mpicc -O2 -march=native -o "$WORKDIR/MatrixVectorProduct" "$SOURCES/MatrixVectorProduct.c" -lm || exit 1
+
+cd "$WORKDIR" || exit 1
+mpirun -np 1 ./MatrixVectorProduct -k "$VECTORS" -r "$SIZE" input.bin > /dev/null
+
+echo "quadratic forms of $VECTORS vectors with a $SIZE x $SIZE matrix"
+for processes in $PROCESSES; do
+	for summation in plain exact; do
+		mpirun --oversubscribe -np "$processes" ./MatrixVectorProduct -k "$VECTORS" -s "$summation" input.bin | grep -E "computation time|vector 0 |final result is"
+	done
+done
+
+rm -rf "$WORKDIR"
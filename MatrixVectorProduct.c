@@ -1,147 +1,399 @@
 /*
- * Read from a binary file a vector X(dim n*1) and a matrix A(dim n*n)
- * and compute X*A*X(transp)
+ * Read from a binary file k vectors X(dim n*1) and a matrix A(dim n*n)
+ * and compute X*A*X(transp) for each of them (optionally, also the products Y=A*X(transp))
  *
  * NOTE: the whole A does not fit in memory
  *
+ * USAGE: MatrixVectorProduct [-k vectors] [-y outputFile] [-d parallel|master|scatter] [-s plain|exact] [-r n] inputFile
+ *  -k = number of vectors in the input file (default 1)
+ *  -y = write the k products A*x in outputFile too, one after another (k vectors of n doubles, no header)
+ *  -d = how the rows of A get to the processes (default parallel, see DISTRIBUTION)
+ *  -s = how the terms x[i]*(A*x)[i] are added up (default plain, see SUMMATION)
+ *  -r = the master first writes in inputFile k random vectors and a random matrix A of size n, just for test
+ *
+ * PROCEDURE:
+ * The rows of A are divided in contiguous blocks, one per process (any number of processes: the first n%p blocks get one more row)
+ * Each process gets the vectors, then streams its block of rows in tiles of at most TILE_SIZE doubles (whole rows, at least one):
+ * while a tile is multiplied the next one is already on its way, so just 2 tiles of A are in memory at a time.
+ * Each tile is multiplied by all the k vectors at once, so A is read from the disk just once for the whole batch:
+ * with one vector a dot product per row, with more vectors the blocked matrix kernel, where they are the columns of B
+ * (each element of A brought in cache is used k times instead of once, see MatrixKernel.h);
+ * then the rows i of the products are weighted by x[i], and finally the partial results are summed on the master
+ *
+ * DISTRIBUTION:
+ *  parallel (default) = each process reads its own tiles from the shared file-system (nonblocking MPI-IO)
+ *  master  = just the master reads the file: before multiplying its own t-th tile, it reads the t-th tile of every other process
+ *            into a pool of POOL_SIZE buffers and sends each of them with a nonblocking send, so the disk reads of the next tiles
+ *            overlap with the sends of the previous ones (a buffer is reused as soon as its send is complete), and all the processes
+ *            (the master too) multiply their tiles at the same time; the processes receive their tiles while multiplying the previous one
+ *  scatter = the master reads the whole A and sends each process its block with a single MPI_Scatterv (when A fits in its memory)
+ *
+ * SUMMATION:
+ *  plain (default) = in doubles, in each process and then by MPI_Reduce: the last digits depend on the number of processes
+ *                    and on the order of the reduction
+ *  exact = each process adds its exact terms (the products and their rounding errors) in a fixed-point accumulator (see ExactSum.h),
+ *          and the accumulators are added exactly by a user-defined MPI_Op: the result is the same bit by bit with any number of processes
+ *          (a row of A * x is always computed by a single process, in the same way, so its terms don't depend on the distribution)
+ *
  * ASSUMPTION:
- *  - a process per row
- *	- vector X fits in memory
+ *  - shared file-system (parallel distribution): each process reads its own rows (and writes its part of the products) with MPI-IO
+ *	- the k vectors fit in memory
  *
  * inputFile's structure:
- * line 1 = double indicating the size
- * line 2 = vector x
- * line 3 and others = matrix A line by line
+ * int = the size n
+ * k*n doubles = the vectors x, one after another
+ * n*n doubles = matrix A row by row
+ *
+ * HYBRID MPI+THREADS: compiled with -fopenmp, each process multiplies its tiles with OMP_NUM_THREADS threads
+ * (only the master thread calls MPI: MPI_THREAD_FUNNELED), and its buffers are touched first by them (see MatrixKernel.h)
  *
  */
 
 #include <stdio.h>
 #include <mpi.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "MatrixKernel.h"
+#include "MatrixIO.h"
+#include "ExactSum.h"
 
 #define MASTER 0
-#define InputFile "/home/lorenzo/Desktop/Programmazione/Workspace/C - C++/C_CPD_1_VectorProduct/data/input.bin"
+#define TILE_TAG 3
+
+// doubles of A in each of the 2 tiles of a process (override with -DTILE_SIZE=...)
+#ifndef TILE_SIZE
+#define TILE_SIZE 1048576
+#endif
+
+// buffers of the master for the tiles being sent (master distribution, override with -DPOOL_SIZE=...)
+#ifndef POOL_SIZE
+#define POOL_SIZE 4
+#endif
+
+int blockStart(int, int, int);
+int blockSize(int, int, int);
+MPI_Offset rowOffset(int, int, int);
+void startTile(MPI_File, int, int, int, int, double*, MPI_Request*);
+void distributeTiles(MPI_File, int, int, int, int, int, double**, MPI_Request*, int*);
+double* scatterRows(MPI_File, int, int, int);
+void multiplyTile(int, int, int, const double*, const double*, double*);
+void exactResults(const double*, const double*, int, int, int, double*, double*);
+void fillInputFile(char*, int, int);
 
 int main(int argc, char **argv){
 
 	// common variable declaration
-	int processID, sizeA;
-	double partialResult;
-	double* vectorX;
-	double* lineOfMatrixA;
-
-	// init MPI's environment
-	MPI_Init(&argc, &argv);
+	int processID, numberOfProcesses, sizeA, threadSupport, option;
+	int numberOfVectors=1, fillSize=-1;
+	char *outputFile=NULL, *distribution="parallel", *summation="plain";
+	double startTime, endTime;
+	double *vectorsX, *tile, *nextTile, *products, *swap, *pool[POOL_SIZE];
+	MPI_File inputFile=MPI_FILE_NULL;
+	MPI_Request request, sends[POOL_SIZE];
+
+	// init MPI's environment: the threads never call MPI, only the master thread does
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
 	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+	if (processID==MASTER && threadSupport<MPI_THREAD_FUNNELED && kernelThreads()>1)
+		printf("Warning: the MPI library does not support MPI_THREAD_FUNNELED\n");
+
+	while ((option=getopt(argc, argv, "k:y:d:s:r:"))!=-1){
+		if (option=='k')
+			numberOfVectors=atoi(optarg);
+		else if (option=='y')
+			outputFile=optarg;
+		else if (option=='d')
+			distribution=optarg;
+		else if (option=='s')
+			summation=optarg;
+		else if (option=='r')
+			fillSize=atoi(optarg);
+		else
+			optind=argc+1;
+	}
+	if (optind!=argc-1 || numberOfVectors<1){
+		if (processID==MASTER)
+			printf("usage: %s [-k vectors] [-y outputFile] [-d parallel|master|scatter] [-s plain|exact] [-r n] inputFile\n", argv[0]);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	int parallelRead=(strcmp(distribution, "parallel")==0), scatter=(strcmp(distribution, "scatter")==0);
+	if (!parallelRead && !scatter && strcmp(distribution, "master")!=0){
+		if (processID==MASTER)
+			printf("Unknown distribution %s (parallel, master or scatter)\n", distribution);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	int exact=(strcmp(summation, "exact")==0);
+	if (!exact && strcmp(summation, "plain")!=0){
+		if (processID==MASTER)
+			printf("Unknown summation %s (plain or exact)\n", summation);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
 
+	// write something in the input file
+	if (fillSize>=0 && processID==MASTER)
+		fillInputFile(argv[optind], fillSize, numberOfVectors);
 
-	// MASTER's work
-	if (processID==MASTER){
+	// the input file must be complete before anybody opens it (with the master and scatter distributions, just the master does)
+	MPI_Barrier(MPI_COMM_WORLD);
+	if ((parallelRead || processID==MASTER) &&
+			MPI_File_open(parallelRead ? MPI_COMM_WORLD : MPI_COMM_SELF, argv[optind], MPI_MODE_RDONLY, MPI_INFO_NULL, &inputFile)!=MPI_SUCCESS){
+		printf("error while opening the file\n");
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
 
-		// variable declaration
-		int i, numberOfProcesses;
-		MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
-
-		// write something in the input file
-		FILE *fp=fopen(InputFile, "wb");
-		if(fp!=NULL){
-			double d[4][3]={{1, 2, 3}, {4, 5, 6}, {7, 8, 9}, {10, 11, 12}};
-			int d2=3;
-			fwrite(&d2, sizeof(int), 1, fp);
-			fwrite(d[0], sizeof(double), 3, fp);
-			fwrite(d[1], sizeof(double), 3, fp);
-			fwrite(d[2], sizeof(double), 3, fp);
-			fwrite(d[3], sizeof(double), 3, fp);
-			fclose(fp);
-		}
+	// everybody gets the size of A and the vectors (vector j starts at vectorsX+j*sizeA: they are the columns of a n x k matrix)
+	if (parallelRead)
+		MPI_File_read_at_all(inputFile, 0, &sizeA, 1, MPI_INT, MPI_STATUS_IGNORE);
+	else {
+		if (processID==MASTER)
+			MPI_File_read_at(inputFile, 0, &sizeA, 1, MPI_INT, MPI_STATUS_IGNORE);
+		MPI_Bcast(&sizeA, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+	}
+	vectorsX=allocateFirstTouch((long)numberOfVectors*sizeA);
+	if (parallelRead)
+		MPI_File_read_at_all(inputFile, sizeof(int), vectorsX, numberOfVectors*sizeA, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	else {
+		if (processID==MASTER)
+			MPI_File_read_at(inputFile, sizeof(int), vectorsX, numberOfVectors*sizeA, MPI_DOUBLE, MPI_STATUS_IGNORE);
+		MPI_Bcast(vectorsX, numberOfVectors*sizeA, MPI_DOUBLE, MASTER, MPI_COMM_WORLD);
+	}
 
+	// then computes its block of rows
+	int startingRow=blockStart(processID, numberOfProcesses, sizeA);
+	int rowsPerProcess=blockSize(processID, numberOfProcesses, sizeA);
 
-		// read from binary file the size of A
-		FILE *filePointer=fopen(InputFile, "rb");
-		if (filePointer==NULL){
-			printf("error while opening the file\n");
-			return 1;
-		}
+	// and how many of them fit in a tile (all of them, when they are scattered at once)
+	int tileRows=(sizeA>0 && TILE_SIZE/sizeA>1) ? TILE_SIZE/sizeA : 1;
+	if (tileRows>rowsPerProcess || scatter)
+		tileRows=rowsPerProcess;
 
-		fread(&sizeA, sizeof(int), 1, filePointer);
-		if (sizeA!=numberOfProcesses){
-			printf("number of processes is different form the size of matrix A\n");
-			return 1;
-		}
+	// the rows of the products A*x of the block, k per row (rowsPerProcess x k, by rows)
+	products=allocateFirstTouch((long)rowsPerProcess*numberOfVectors);
 
-		MPI_Bcast(&sizeA, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-		printf("sent sizeA=%d\n", sizeA);
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime=MPI_Wtime();
+
+
+	// DISTRIBUTION: the tiles are read by each process (parallel) or come from the master (master), or the whole block does (scatter)
+	// NOTE: with the master distribution the master reads its own tiles like in the parallel one, and sends the other ones
+	// while it goes through them (its block is the biggest, so it has at least as many tiles as any other process)
+	int distributing=(!parallelRead && !scatter && processID==MASTER), buffer, next=0;
+	if (scatter){
+		tile=scatterRows(inputFile, sizeA, numberOfVectors, rowsPerProcess);
+		nextTile=NULL;
+	}
+	else {
+		tile=allocateFirstTouch((long)tileRows*sizeA);
+		nextTile=allocateFirstTouch((long)tileRows*sizeA);
+	}
+	if (distributing)
+		for (buffer=0; buffer<POOL_SIZE; buffer++){
+			pool[buffer]=(double*)malloc(sizeof(double)*((long)tileRows*sizeA+1));
+			sends[buffer]=MPI_REQUEST_NULL;
+		}
 
-		// read the vector (read sizeA doubles)
-		vectorX=(double*)malloc(sizeof(double)*sizeA);
-		fread(vectorX, sizeof(double), sizeA, filePointer);
-		MPI_Bcast(vectorX, sizeA, MPI_DOUBLE, MASTER, MPI_COMM_WORLD);
-		printf("sent vectorX=[%lf, %lf, %lf]\n", vectorX[0], vectorX[1], vectorX[2]);
 
+	// COMMON WORK: the first tile arrives, then each one is multiplied while the next one is on its way
+	int row, rows, nextRows, i, j;
+	if (rowsPerProcess>0 && !scatter)
+		startTile(inputFile, startingRow, tileRows, sizeA, numberOfVectors, tile, &request);
 
-		for (i=1; i<sizeA; i++){
+	for (row=0; row<rowsPerProcess; row+=rows){
+		rows=(rowsPerProcess-row<tileRows) ? rowsPerProcess-row : tileRows;
 
-			// read a line of A and send it
-			lineOfMatrixA=(double*)malloc(sizeof(double)*sizeA);
-			fread(lineOfMatrixA, sizeof(double), sizeA, filePointer);
-			MPI_Send(lineOfMatrixA, sizeA, MPI_DOUBLE, i, 3, MPI_COMM_WORLD);
-			printf("master has sent to slave %d the line=[%lf, %lf, %lf]\n", i, lineOfMatrixA[0], lineOfMatrixA[1], lineOfMatrixA[2]);
-			free(lineOfMatrixA);
+		if (!scatter){
+			MPI_Wait(&request, MPI_STATUS_IGNORE);
+			nextRows=(rowsPerProcess-row-rows<tileRows) ? rowsPerProcess-row-rows : tileRows;
+			if (nextRows>0)
+				startTile(inputFile, startingRow+row+rows, nextRows, sizeA, numberOfVectors, nextTile, &request);
 		}
 
-		// finally MASTER reads its part
-		lineOfMatrixA=(double*)malloc(sizeof(double)*sizeA);
-		fread(lineOfMatrixA, sizeof(double), sizeA, filePointer);
-		printf("master has read the line=[%lf, %lf, %lf]\n", lineOfMatrixA[0], lineOfMatrixA[1], lineOfMatrixA[2]);
+		// the other processes get their tile of this round before the master multiplies its own one
+		if (distributing)
+			distributeTiles(inputFile, sizeA, numberOfVectors, numberOfProcesses, tileRows, row/tileRows, pool, sends, &next);
 
-		// close the input file
-		fclose(filePointer);
-	}
+		multiplyTile(rows, sizeA, numberOfVectors, tile, vectorsX, products+(long)row*numberOfVectors);
 
+		swap=tile; tile=nextTile; nextTile=swap;
+	}
 
-	// SLAVES' WORK
+	if (distributing){
+		MPI_Waitall(POOL_SIZE, sends, MPI_STATUSES_IGNORE);
+		for (buffer=0; buffer<POOL_SIZE; buffer++)
+			free(pool[buffer]);
+	}
+	if (inputFile!=MPI_FILE_NULL)
+		MPI_File_close(&inputFile);
+
+	// row i of the product A*x is weighted by x[i]
+	double *partialResults=(double*)calloc(numberOfVectors, sizeof(double));
+	double *results=(double*)malloc(sizeof(double)*numberOfVectors);
+	if (exact)
+		exactResults(products, vectorsX+startingRow, sizeA, numberOfVectors, rowsPerProcess, partialResults, results);
 	else {
+		for (i=0; i<rowsPerProcess; i++)
+			for (j=0; j<numberOfVectors; j++)
+				partialResults[j]+=vectorsX[(long)j*sizeA+startingRow+i]*products[(long)i*numberOfVectors+j];
 
-		// receive data from master
-		MPI_Bcast(&sizeA, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+		// final reduction for computing the results (along the tree of the MPI library)
+		MPI_Reduce(partialResults, results, numberOfVectors, MPI_DOUBLE, MPI_SUM, MASTER, MPI_COMM_WORLD);
+	}
 
+	printf("process %d has computed value %lf (rows %d-%d)\n", processID, partialResults[0], startingRow, startingRow+rowsPerProcess-1);
 
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime=MPI_Wtime();
 
-			vectorX=(double*)malloc(sizeof(double)*sizeA);
-			MPI_Bcast(vectorX, sizeA, MPI_DOUBLE, MASTER, MPI_COMM_WORLD);
+	if (processID==MASTER){
+		printf("computation time with %d processes and %d vectors (%s distribution, %s summation, I/O included): %f s\n",
+				numberOfProcesses, numberOfVectors, distribution, summation, endTime-startTime);
+		if (numberOfVectors==1)
+			printf("the final result is: %.17g\n", results[0]);
+		else
+			for (j=0; j<numberOfVectors; j++)
+				printf("the final result of vector %d is: %.17g\n", j, results[j]);
+	}
 
-			lineOfMatrixA=(double*)malloc(sizeof(double)*sizeA);
-			MPI_Recv(lineOfMatrixA, sizeA, MPI_DOUBLE, MASTER, 3, MPI_COMM_WORLD, NULL);
+	if (outputFile!=NULL)
+		writeProducts(outputFile, products, sizeA, numberOfVectors, startingRow, rowsPerProcess);
 
-	}
+	// free memory
+	free(vectorsX); free(tile); free(nextTile); free(products); free(partialResults); free(results);
 
-	// COMMON WORK
+	MPI_Finalize();
 
-		int i;
-		for (i=0; i<sizeA; i++)
-			partialResult+=vectorX[i]*lineOfMatrixA[i];
+	return 0;
+}
 
-		partialResult*=vectorX[(processID+sizeA-1)%sizeA];
 
-		printf("slave %d has computed value %lf\n", processID, partialResult);
+// first row of the block of process id, when n rows are divided in parts blocks (the first n%parts blocks get one more row)
+int blockStart(int id, int parts, int n){
+	return id*(n/parts)+((id<n%parts) ? id : n%parts);
+}
 
+// number of rows of the block of process id
+int blockSize(int id, int parts, int n){
+	return n/parts+((id<n%parts) ? 1 : 0);
+}
 
-		// final reduction for computing the result
-		double result;
+// position in the input file of the row-th row of A (after the size and the vectors)
+MPI_Offset rowOffset(int row, int sizeA, int numberOfVectors){
+	return sizeof(int)+((MPI_Offset)row+numberOfVectors)*sizeA*sizeof(double);
+}
 
+// starts reading rows rows of A from the row-th one in the tile: from the file if this process has it open, otherwise from the master
+void startTile(MPI_File inputFile, int row, int rows, int sizeA, int numberOfVectors, double* tile, MPI_Request* request){
+	if (inputFile!=MPI_FILE_NULL)
+		MPI_File_iread_at(inputFile, rowOffset(row, sizeA, numberOfVectors), tile, rows*sizeA, MPI_DOUBLE, request);
+	else
+		MPI_Irecv(tile, rows*sizeA, MPI_DOUBLE, MASTER, TILE_TAG, MPI_COMM_WORLD, request);
+}
 
-		MPI_Reduce(&partialResult, &result, 1, MPI_DOUBLE, MPI_SUM, MASTER, MPI_COMM_WORLD);
+// THE MASTER READS THE TILE-TH TILE OF EACH OTHER PROCESS (OF THE ONES THAT HAVE SO MANY) AND SENDS IT
+// each tile goes in the next buffer of the pool, as soon as the send of the tile that was in it is complete:
+// so up to POOL_SIZE-1 sends proceed while the next tile is read from the disk, and no buffer is allocated per tile
+// (tileRows are the ones of the master: no other block is bigger, so they are the ones of every process that has at least as many rows)
+void distributeTiles(MPI_File inputFile, int sizeA, int numberOfVectors, int numberOfProcesses, int tileRows, int tile,
+		double** pool, MPI_Request* sends, int* next){
+	int process, row, rows, blockRows, processTileRows;
+
+	for (process=1; process<numberOfProcesses; process++){
+		blockRows=blockSize(process, numberOfProcesses, sizeA);
+
+		// the same tiles the process expects (see the common work)
+		processTileRows=(tileRows>blockRows) ? blockRows : tileRows;
+		row=tile*processTileRows;
+		if (row>=blockRows)
+			continue;
+		rows=(blockRows-row<processTileRows) ? blockRows-row : processTileRows;
+		MPI_Wait(&sends[*next], MPI_STATUS_IGNORE);
+		MPI_File_read_at(inputFile, rowOffset(blockStart(process, numberOfProcesses, sizeA)+row, sizeA, numberOfVectors),
+				pool[*next], rows*sizeA, MPI_DOUBLE, MPI_STATUS_IGNORE);
+		MPI_Isend(pool[*next], rows*sizeA, MPI_DOUBLE, process, TILE_TAG, MPI_COMM_WORLD, &sends[*next]);
+		*next=(*next+1)%POOL_SIZE;
+	}
+}
 
+// THE MASTER READS THE WHOLE A AND EACH PROCESS GETS ITS BLOCK OF ROWS WITH A SINGLE MPI_SCATTERV
+double* scatterRows(MPI_File inputFile, int sizeA, int numberOfVectors, int rows){
+	int processID, numberOfProcesses, process;
+	double *matrixA=NULL, *block=allocateFirstTouch((long)rows*sizeA);
 
-		// free memory
+	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+	int counts[numberOfProcesses], offsets[numberOfProcesses];
 
-		free(vectorX); free(lineOfMatrixA);
+	for (process=0; process<numberOfProcesses; process++){
+		counts[process]=blockSize(process, numberOfProcesses, sizeA)*sizeA;
+		offsets[process]=blockStart(process, numberOfProcesses, sizeA)*sizeA;
+	}
 
-		if (processID==MASTER)
-			printf("the final result is: %lf\n", result);
+	if (processID==MASTER){
+		matrixA=(double*)malloc(sizeof(double)*((long)sizeA*sizeA+1));
+		MPI_File_read_at(inputFile, rowOffset(0, sizeA, numberOfVectors), matrixA, sizeA*sizeA, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	}
+	MPI_Scatterv(matrixA, counts, offsets, MPI_DOUBLE, block, rows*sizeA, MPI_DOUBLE, MASTER, MPI_COMM_WORLD);
 
+	free(matrixA);
+	return block;
+}
 
-	MPI_Finalize();
+// products (rows x k, by rows) = tile (rows x n, by rows) * the k vectors (n x k, by columns)
+// a single vector is just a dot product per row, while a batch is a matrix product (the micro-kernel would waste most of its tile on a single column)
+void multiplyTile(int rows, int sizeA, int numberOfVectors, const double* tile, const double* vectorsX, double* products){
+	if (numberOfVectors==1)
+		matrixVectorRows(rows, sizeA, tile, vectorsX, products);
+	else
+		multiplyBlock(rows, numberOfVectors, sizeA, tile, sizeA, vectorsX, sizeA, products, numberOfVectors);
+}
 
-	return 0;
+// EXACT SUMMATION: EACH PROCESS ADDS ITS TERMS X[I]*(A*X)[I] (ROWS X K, X FROM ITS STARTING ROW) EXACTLY, THEN THE MASTER GETS THE EXACT TOTALS
+// partialResults and results (on the master) get the values of the accumulators of the process and of the totals
+void exactResults(const double* products, const double* vectorsX, int sizeA, int numberOfVectors, int rows, double* partialResults, double* results){
+	ExactSum *partialSums=(ExactSum*)calloc(numberOfVectors, sizeof(ExactSum));
+	ExactSum *sums=(ExactSum*)calloc(numberOfVectors, sizeof(ExactSum));
+	MPI_Datatype exactSumType;
+	MPI_Op exactSumOp;
+	int i, j;
+
+	for (i=0; i<rows; i++)
+		for (j=0; j<numberOfVectors; j++)
+			exactSumAddProduct(&partialSums[j], vectorsX[(long)j*sizeA+i], products[(long)i*numberOfVectors+j]);
+
+	// the MPI_Op adds normalized accumulators
+	for (j=0; j<numberOfVectors; j++){
+		exactSumNormalize(&partialSums[j]);
+		partialResults[j]=exactSumValue(&partialSums[j]);
+	}
+
+	exactSumMPI(&exactSumType, &exactSumOp);
+	MPI_Reduce(partialSums, sums, numberOfVectors, exactSumType, exactSumOp, MASTER, MPI_COMM_WORLD);
+	MPI_Op_free(&exactSumOp);
+	MPI_Type_free(&exactSumType);
+
+	for (j=0; j<numberOfVectors; j++)
+		results[j]=exactSumValue(&sums[j]);
+
+	free(partialSums); free(sums);
+}
+
+// auxiliary function, just for testing purpose
+// writes in the input file the size n, k random vectors and a random n x n matrix (values between -1 and 1), a row at a time
+void fillInputFile(char* file, int n, int numberOfVectors){
+	FILE *fp=fopen(file, "wb");
+	if (fp!=NULL){
+		int i, j;
+		double *line=(double*)malloc(sizeof(double)*(n>0 ? n : 1));
+		fwrite(&n, sizeof(int), 1, fp);
+		for (i=0; i<n+numberOfVectors; i++){
+			for (j=0; j<n; j++)
+				line[j]=2.0*rand()/RAND_MAX-1.0;
+			fwrite(line, sizeof(double), n, fp);
+		}
+		free(line);
+		fclose(fp);
+	}
 }
@@ -2,17 +2,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "LocalSort.h"
+#include "SortIO.h"
+
 #define MASTER 0
 
-void sortData(int*, int);
-void fillInputFile(char*);
+// 1 = each slave reads its part of the input file with MPI-IO (shared file-system)
+// 0 = the master reads the file and sends the chunks (override with -DPARALLEL_IO=0)
+#ifndef PARALLEL_IO
+#define PARALLEL_IO 1
+#endif
+
+// number of elements sent to the master in a single message (override with -DBLOCK_SIZE=...)
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE 4096
+#endif
+
+typedef struct
+{
+	ElementKey value;
+	int source;
+} HeapNode;
 
-int MAX_INT = 999;
+void siftDown(HeapNode*, int, int);
+int slaveChunkSize(int, int, int);
+void fillSampleFile(char*);
 
 int main(int argc, char *argv[])
 {
 	int processId, numberOfProcesses, chunkSize, numberOfElements;;
-	int *chunk = NULL;
+	MPI_Offset chunkOffset;
+	Element *chunk = NULL;
 	MPI_Init(&argc, &argv);
 	MPI_Comm_rank(MPI_COMM_WORLD, &processId);
 	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
@@ -29,65 +49,126 @@ int main(int argc, char *argv[])
 			return 0;
 		}
 
-		fillInputFile(argv[1]);
+		fillSampleFile(argv[1]);
 
-
-		FILE *inputFilePtr = fopen(argv[1], "rb");
-
-		if (inputFilePtr==NULL)
+		if (PARALLEL_IO)
 		{
-			printf("Error while opening the input file\n");
-			MPI_Abort(MPI_COMM_WORLD, 0);
-			return 0;
+			// the input file must be complete before anybody opens it
+			// (the slaves split it, the master is out of the split with id -1 and gets an empty chunk)
+			MPI_Barrier(MPI_COMM_WORLD);
+			chunk = readChunkParallel(argv[1], processId-1, numberOfProcesses-1, &numberOfElements, &chunkSize, &chunkOffset);
 		}
+		else
+		{
+			FILE *inputFilePtr = fopen(argv[1], "rb");
 
-		fread(&numberOfElements, 1, sizeof(int), inputFilePtr);
-		MPI_Bcast(&numberOfElements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+			if (inputFilePtr==NULL)
+			{
+				printf("Error while opening the input file\n");
+				MPI_Abort(MPI_COMM_WORLD, 0);
+				return 0;
+			}
 
-		int elementsPerProcess = numberOfElements / (numberOfProcesses-1);
-		int rest = numberOfElements % (numberOfProcesses-1);
+			fread(&numberOfElements, 1, sizeof(int), inputFilePtr);
+			MPI_Bcast(&numberOfElements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
 
-		for (int i = 1; i < numberOfProcesses; ++i)
-		{
-			chunkSize = elementsPerProcess;
-			chunkSize += (i <= rest) ? 1 : 0;
+			for (int i = 1; i < numberOfProcesses; ++i)
+			{
+				chunkSize = slaveChunkSize(i, numberOfProcesses, numberOfElements);
 
-			chunk = realloc(chunk, chunkSize * sizeof(int));
+				chunk = realloc(chunk, chunkSize * sizeof(Element));
 
-			fread(chunk, chunkSize, sizeof(int), inputFilePtr);
+				fread(chunk, chunkSize, sizeof(Element), inputFilePtr);
 
-			MPI_Send(&chunkSize, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
-			MPI_Send(chunk, chunkSize, MPI_INT, i, 1, MPI_COMM_WORLD);
-		}
+				MPI_Send(&chunkSize, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
+				MPI_Send(chunk, chunkSize, ELEMENT_MPI_TYPE, i, 1, MPI_COMM_WORLD);
+			}
 
-		fclose(inputFilePtr);
+			fclose(inputFilePtr);
+		}
 
 
 	/********************************************* MASTER PART 2 *********************************************/
 
-		int *receivedMins = malloc(numberOfProcesses * sizeof(int));
-		int minVal, minIndex;
+		// per slave: the block being merged, the block being received, and how many elements are still to receive
+		Element **currentBlock = malloc(numberOfProcesses * sizeof(Element*));
+		Element **nextBlock = malloc(numberOfProcesses * sizeof(Element*));
+		int *blockLength = malloc(numberOfProcesses * sizeof(int));
+		int *position = malloc(numberOfProcesses * sizeof(int));
+		int *remaining = malloc(numberOfProcesses * sizeof(int));
+		MPI_Request *nextBlockRequest = malloc(numberOfProcesses * sizeof(MPI_Request));
+
+		// heap of the smallest not yet merged element of each slave
+		HeapNode *heap = malloc(numberOfProcesses * sizeof(HeapNode));
+		int heapSize = 0;
+
+		for (int i = 1; i < numberOfProcesses; ++i)
+		{
+			remaining[i] = slaveChunkSize(i, numberOfProcesses, numberOfElements);
+			if (remaining[i]==0)
+				continue;
+
+			currentBlock[i] = malloc(BLOCK_SIZE * sizeof(Element));
+			nextBlock[i] = malloc(BLOCK_SIZE * sizeof(Element));
+
+			blockLength[i] = (remaining[i] < BLOCK_SIZE) ? remaining[i] : BLOCK_SIZE;
+			MPI_Recv(currentBlock[i], blockLength[i], ELEMENT_MPI_TYPE, i, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			remaining[i] -= blockLength[i];
+			position[i] = 0;
+
+			// start receiving the following block while this one is merged
+			if (remaining[i]>0)
+				MPI_Irecv(nextBlock[i], (remaining[i] < BLOCK_SIZE) ? remaining[i] : BLOCK_SIZE, ELEMENT_MPI_TYPE, i, 2, MPI_COMM_WORLD, &nextBlockRequest[i]);
+
+			heap[heapSize].value = ELEMENT_KEY(currentBlock[i][0]);
+			heap[heapSize].source = i;
+			heapSize++;
+		}
+
+		for (int i = heapSize/2 - 1; i >= 0; --i)
+			siftDown(heap, heapSize, i);
 
 		for (int globalIterator = 0; globalIterator < numberOfElements; ++globalIterator)
 		{
-			minVal=MAX_INT;
-			minIndex=0;
+			int minIndex = heap[0].source;
 
-			MPI_Gather(&MAX_INT, 1, MPI_INT, receivedMins, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-			for (int i = 0; i < numberOfProcesses; ++i)
+			printf("Num %d = " KEY_FORMAT "\n", globalIterator+1, heap[0].value);
+
+			// the block of the winner ran dry: switch to the one already on its way, and ask for the following one
+			if (++position[minIndex]==blockLength[minIndex])
 			{
-				if (receivedMins[i]<minVal)
+				if (remaining[minIndex]>0)
 				{
-					minVal = receivedMins[i];
-					minIndex = i;
+					Element *swap = currentBlock[minIndex];
+					currentBlock[minIndex] = nextBlock[minIndex];
+					nextBlock[minIndex] = swap;
+
+					MPI_Wait(&nextBlockRequest[minIndex], MPI_STATUS_IGNORE);
+					blockLength[minIndex] = (remaining[minIndex] < BLOCK_SIZE) ? remaining[minIndex] : BLOCK_SIZE;
+					remaining[minIndex] -= blockLength[minIndex];
+					position[minIndex] = 0;
+
+					if (remaining[minIndex]>0)
+						MPI_Irecv(nextBlock[minIndex], (remaining[minIndex] < BLOCK_SIZE) ? remaining[minIndex] : BLOCK_SIZE, ELEMENT_MPI_TYPE, minIndex, 2, MPI_COMM_WORLD, &nextBlockRequest[minIndex]);
+				}
+
+				// or the slave has nothing left at all
+				else
+				{
+					free(currentBlock[minIndex]);
+					free(nextBlock[minIndex]);
+					heap[0] = heap[--heapSize];
+					siftDown(heap, heapSize, 0);
+					continue;
 				}
 			}
 
-			printf("Num %d = %d\n", globalIterator+1, minVal);
-			MPI_Bcast(&minIndex, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+			heap[0].value = ELEMENT_KEY(currentBlock[minIndex][position[minIndex]]);
+			siftDown(heap, heapSize, 0);
 		}
 
-		free(receivedMins);
+		free(heap);
+		free(currentBlock); free(nextBlock); free(blockLength); free(position); free(remaining); free(nextBlockRequest);
 	}
 
 
@@ -96,32 +177,28 @@ int main(int argc, char *argv[])
 
 	else
 	{
-		MPI_Bcast(&numberOfElements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-		MPI_Recv(&chunkSize, 1, MPI_INT, MASTER, 0, MPI_COMM_WORLD, NULL);
-		chunk = realloc(chunk, chunkSize * sizeof(int));
-		MPI_Recv(chunk, chunkSize, MPI_INT, MASTER, 1, MPI_COMM_WORLD, NULL);
+		if (PARALLEL_IO)
+		{
+			MPI_Barrier(MPI_COMM_WORLD);
+			chunk = readChunkParallel(argv[1], processId-1, numberOfProcesses-1, &numberOfElements, &chunkSize, &chunkOffset);
+		}
+		else
+		{
+			MPI_Bcast(&numberOfElements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+			MPI_Recv(&chunkSize, 1, MPI_INT, MASTER, 0, MPI_COMM_WORLD, NULL);
+			chunk = realloc(chunk, chunkSize * sizeof(Element));
+			MPI_Recv(chunk, chunkSize, ELEMENT_MPI_TYPE, MASTER, 1, MPI_COMM_WORLD, NULL);
+		}
 
-		sortData(chunk, chunkSize);
+		localSort(chunk, chunkSize);
 
 
 	/********************************************* SLAVES PART 2 *********************************************/
 
-		int position = 0, winner;
-
-		for (int globalIterator = 0; globalIterator < numberOfElements; ++globalIterator)
-		{
-
-			if (position < chunkSize)
-			{
-				MPI_Gather(&chunk[position], 1, MPI_INT, NULL, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-			} else {
-				MPI_Gather(&MAX_INT, 1, MPI_INT, NULL, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-			}
-
-			MPI_Bcast(&winner, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-
-			position += (winner == processId) ? 1 : 0;
-		}
+		// stream the sorted chunk to the master, one block at a time
+		// NOTE: synchronous sends, so the master never buffers more than two blocks per slave
+		for (int position = 0; position < chunkSize; position += BLOCK_SIZE)
+			MPI_Ssend(&chunk[position], (chunkSize-position < BLOCK_SIZE) ? chunkSize-position : BLOCK_SIZE, ELEMENT_MPI_TYPE, MASTER, 2, MPI_COMM_WORLD);
 	}
 
 
@@ -135,31 +212,48 @@ int main(int argc, char *argv[])
 
 
 
-void sortData(int *chunk, int size)
+void siftDown(HeapNode *heap, int size, int i)
 {
-	int tmp;
-	for (int i = 0; i < size; ++i)
+	HeapNode tmp;
+	int smallest;
+	while ((smallest = 2*i+1) < size)
 	{
-		for (int j = 0; j < size; ++j)
-		{
-			if (chunk[j]>chunk[j+1])
-			{
-				tmp = chunk[j];
-				chunk[j] = chunk[j+1];
-				chunk[j+1] = tmp;
-			}
-		}
+		if (smallest+1 < size && heap[smallest+1].value < heap[smallest].value)
+			smallest++;
+		if (heap[i].value <= heap[smallest].value)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = tmp;
+		i = smallest;
 	}
 }
 
-void fillInputFile(char *path)
+// the master has nothing to sort, the slaves split the elements evenly (see SortIO.h)
+int slaveChunkSize(int processId, int numberOfProcesses, int numberOfElements)
+{
+	int chunkSize = 0;
+	MPI_Offset chunkOffset;
+	if (processId!=MASTER)
+		balancedChunk(processId-1, numberOfProcesses-1, numberOfElements, &chunkSize, &chunkOffset);
+	return chunkSize;
+}
+
+void fillSampleFile(char *path)
 {
 	int a = 20;
 	int b[] = {1,5,9,15,15,1,4,84,3,4,38,48,3,54,8,6,4,4,87,6};
+	Element elements[20];
+
+	for (int i = 0; i < a; ++i)
+		elements[i] = makeElement(b[i]);
 
+	// (when it can't be written, reading it aborts)
 	FILE *f=fopen(path, "wb");
+	if (f==NULL)
+		return;
 	fwrite(&a, 1, sizeof(int), f);
-	fwrite(&b, a, sizeof(int), f);
+	fwrite(elements, a, sizeof(Element), f);
 	fclose(f);
 }
 
@@ -3,48 +3,81 @@
  *
  * FILE STRUCTURE:
  * first line= integer representing the number of elements
- * other lines= an integer to be sorted for each line
+ * other lines= an element to be sorted for each line (an int by default, see SortElement.h)
  *
  * PROCEDURE:
- * Each node has a portion (chunk) of data
- * During an iteration, node k sends his chunk to node k+1
- * node k+1 computes the sorted chunk, splits it in half and sends half of it back to node k
+ * Each node has a portion (chunk) of data, which it sorts once before the first iteration
+ * During an iteration, node k and node k+1 swap their chunks at once
+ * and both merge them (compare-split): node k keeps the low part, node k+1 the high part
+ * Before that, the partners swap just their boundary keys: then each one sends only the elements that can cross
+ * the partner's boundary (found by binary search), and nothing at all if the chunks are already in order
+ * The sort stops as soon as two iterations in a row have changed nothing (one-int MPI_Allreduce per iteration),
+ * and the master prints how many of the p+1 iterations it has saved
  *
- * ASSUMPTION: a node can handle 2 chunks of data in memory
+ * ASSUMPTION: a node can handle 3 chunks of data in memory (its own, the partner's and the merge output)
+ *   (for inputs bigger than the memory of the nodes see ExternalSort.c)
+ * with PARALLEL_IO, a shared file-system: each node reads and writes its own part of the files with MPI-IO
  *
  */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "LocalSort.h"
+#include "SortIO.h"
 
 #define MASTER 0
 #define inputFile "../data/input.bin"
 #define outputFile "../data/output.bin"
 
-void sort (int*, int);
-void fillInputFile(char*, int);
-void printVector(int*, int);
+// number of random elements written in the input file (override with -DNUMBER_OF_ELEMENTS=...)
+#ifndef NUMBER_OF_ELEMENTS
+#define NUMBER_OF_ELEMENTS 15
+#endif
+
+// 1 = each node reads and writes its part of the files with MPI-IO (shared file-system)
+// 0 = the master reads and writes the files, and sends and receives the chunks (override with -DPARALLEL_IO=0)
+#ifndef PARALLEL_IO
+#define PARALLEL_IO 1
+#endif
 
 int main (int argc, char** argv){
 
 	// common local variable declaration
-	int processID, numberOfProcesses, chunkSize;
-	int *chunk;
+	int processID, numberOfProcesses, chunkSize, totalNumberOfElements;
+	Element *chunk;
+	MPI_Offset chunkOffset;
 
 	// init mpi environment
 	MPI_Init(&argc, &argv);
 	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
 	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
 
-	// MASTER'S WORK
-	if (processID==0) {
+	// write something in the input file
+	if (processID==MASTER){
+		fillInputFile(inputFile, NUMBER_OF_ELEMENTS);
+	}
+
+	// PARALLEL I/O: each node reads its own part of the input file
+	if (PARALLEL_IO){
+
+		// the input file must be complete before anybody opens it
+		MPI_Barrier(MPI_COMM_WORLD);
+		chunk=readChunkParallel(inputFile, processID, numberOfProcesses, &totalNumberOfElements, &chunkSize, &chunkOffset);
 
-		// write something in the input file
-		fillInputFile(inputFile, 15); printf("\n");
+		// test prints
+		printf ("process %d has read the vector: ", processID);
+		printVector(chunk, chunkSize);
+		printf("\n");
+	}
+
+	// MASTER'S WORK
+	else if (processID==0) {
 
 		// master's local variable declaration
-		int totalNumberOfElements, result, rest;
+		int result, rest;
 
 		// read the number of elements
 		FILE *inputFilePtr=fopen(inputFile, "rb");
@@ -67,16 +100,14 @@ int main (int argc, char** argv){
 					chunkSize=result;
 
 				// allocate memory for a chunk
-				chunk=(int*)malloc(sizeof(int)*chunkSize);
+				chunk=(Element*)malloc(sizeof(Element)*chunkSize);
 
 				// read numberOfElements numbers
-				int it;
-				for (it=0; it<chunkSize; it++)
-					fread((chunk+it), sizeof(int), 1, inputFilePtr);
+				fread(chunk, sizeof(Element), chunkSize, inputFilePtr);
 
 				// send data to a slave
 				MPI_Send(&chunkSize, 1, MPI_INT, counter, 0, MPI_COMM_WORLD);
-				MPI_Send(chunk, chunkSize, MPI_INT, counter, 1, MPI_COMM_WORLD);
+				MPI_Send(chunk, chunkSize, ELEMENT_MPI_TYPE, counter, 1, MPI_COMM_WORLD);
 
 				// free the memory
 				free(chunk);
@@ -87,10 +118,8 @@ int main (int argc, char** argv){
 
 			// finally master reads his part too (rest is <=0 for sure)
 			chunkSize=result;
-			chunk=(int*)malloc(sizeof(int)*chunkSize);
-			int it;
-			for (it=0; it<chunkSize; it++)
-				fread((chunk+it), sizeof(int), 1, inputFilePtr);
+			chunk=(Element*)malloc(sizeof(Element)*chunkSize);
+			fread(chunk, sizeof(Element), chunkSize, inputFilePtr);
 
 			// test print
 			printf ("master has the vector: ");
@@ -99,8 +128,13 @@ int main (int argc, char** argv){
 
 			fclose(inputFilePtr);
 		}
-		else
-			printf ("error while opening the file");
+
+		// nobody can go on without the input
+		else {
+			printf ("error while opening the file\n");
+			MPI_Abort(MPI_COMM_WORLD, 0);
+			return 0;
+		}
 	}
 
 	// BEGIN OF SLAVES' WORK (they just have to receive data from MASTER)
@@ -110,8 +144,8 @@ int main (int argc, char** argv){
 		MPI_Recv(&chunkSize, 1, MPI_INT, MASTER, 0, MPI_COMM_WORLD, NULL);
 
 		// store the chunk
-		chunk=(int*)malloc(sizeof(int)*chunkSize);
-		MPI_Recv(chunk, chunkSize, MPI_INT, MASTER, 1, MPI_COMM_WORLD, NULL);
+		chunk=(Element*)malloc(sizeof(Element)*chunkSize);
+		MPI_Recv(chunk, chunkSize, ELEMENT_MPI_TYPE, MASTER, 1, MPI_COMM_WORLD, NULL);
 
 		// test prints
 		printf ("process %d has received the vector: ", processID);
@@ -122,66 +156,136 @@ int main (int argc, char** argv){
 	// NOW EACH NODE HAS ITS OWN CHUNK.
 	// BEGIN OF THE COMMON PARALLEL WORK: DISTRIBUTED ODD-EVEN SORT
 	int globalIterator; int maxIterations=numberOfProcesses+1;
-	for (globalIterator=2; globalIterator<maxIterations+2; globalIterator++)
-
-		// SENDER PART - if it's a "sender process", and exists a process with rank +1
+	double startTime, endTime;
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime=MPI_Wtime();
+
+	// sort the local chunk once: from now on every exchange is a linear merge of two sorted chunks
+	localSort(chunk, chunkSize);
+
+	// the partner's chunk can't be bigger than the biggest chunk around
+	int maxChunkSize;
+	MPI_Allreduce(&chunkSize, &maxChunkSize, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+	// buffers for the partner's elements and for the ones of ours they are merged with, reused by every iteration
+	Element *newChunk=(Element*)malloc(sizeof(Element)*maxChunkSize);
+	Element *mergedChunk=(Element*)malloc(sizeof(Element)*chunkSize);
+	Element myBoundary, partnerBoundary;
+	int newChunkSize, partner, partnerSize, sendStart, sendCount, changed, anyChanged, quietRounds=0, rounds=0;
+	long long elementsSent=0, chunkElements=0, totalElementsSent, totalChunkElements;
+	MPI_Status status;
+
+	// the chunk sizes never change during the sort, and no distribution keeps them ordered by rank (the master's is the smallest
+	// without PARALLEL_IO): so each node learns the sizes of its two neighbours once, before the first iteration
+	int lowerSize=0, upperSize=0;
+	int lowerNeighbour=(processID>MASTER) ? processID-1 : MPI_PROC_NULL;
+	int upperNeighbour=(processID<numberOfProcesses-1) ? processID+1 : MPI_PROC_NULL;
+	MPI_Sendrecv(&chunkSize, 1, MPI_INT, upperNeighbour, 0, &lowerSize, 1, MPI_INT, lowerNeighbour, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(&chunkSize, 1, MPI_INT, lowerNeighbour, 1, &upperSize, 1, MPI_INT, upperNeighbour, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+	for (globalIterator=2; globalIterator<maxIterations+2; globalIterator++){
+		rounds++;
+		changed=0;
+
+		// LOWER PART - if exists a process with rank +1
 		if (processID%2==globalIterator%2 && processID<numberOfProcesses-1){
+			partner=processID+1;
+			partnerSize=upperSize;
+		}
 
-			MPI_Send(&chunkSize, 1, MPI_INT, processID+1, globalIterator, MPI_COMM_WORLD);
-			MPI_Send(chunk, chunkSize, MPI_INT, processID+1, globalIterator+maxIterations, MPI_COMM_WORLD);
-			printf("process %d has sent to process %d the chunk: ", processID, processID+1);
-			printVector(chunk, chunkSize); printf("\n");
-
-			// wait for the result from node +1
-			MPI_Recv(chunk, chunkSize, MPI_INT, processID+1, globalIterator+2*maxIterations, MPI_COMM_WORLD, NULL);
-			printf("process %d has received from process %d the chunk: ", processID, processID+1);
-			printVector(chunk, chunkSize); printf("\n");
+		// UPPER PART - otherwise (master is never an upper part, since does not exist a process with a minor rank)
+		else if (processID%2!=globalIterator%2 && processID>MASTER){
+			partner=processID-1;
+			partnerSize=lowerSize;
 		}
 
-	// RECEIVER PART - otherwise (master won't receive data, since does not exist a process with a minor rank)
-		else if(processID%2!=globalIterator%2 && processID>MASTER)  {
-
-			// receive data from that process
-			int newChunkSize; int* newChunk;
-			MPI_Recv(&newChunkSize, 1, MPI_INT, processID-1, globalIterator, MPI_COMM_WORLD, NULL);
-			newChunk=(int*)malloc(newChunkSize*sizeof(int));
-			MPI_Recv(newChunk, newChunkSize, MPI_INT, processID-1, globalIterator+maxIterations, MPI_COMM_WORLD, NULL);
-
-			printf("process %d has received from process %d the chunk: ", processID, processID-1);
-			printVector(newChunk, newChunkSize); printf("\n");
-
-			// put everything together
-			int i; int* commonChunk=(int*)malloc((newChunkSize+chunkSize)*sizeof(int));
-			for (i=0; i< chunkSize; i++)
-				commonChunk[i]=chunk[i];
-			for (i=0; i< newChunkSize; i++)
-				commonChunk[i+chunkSize]=newChunk[i];
-
-			// sort this common chunk
-			sort(commonChunk, newChunkSize+chunkSize);
-
-			for (i=0; i< newChunkSize; i++)
-				newChunk[i]=commonChunk[i];
-			for (i=newChunkSize; i<newChunkSize+chunkSize; i++)
-				chunk[i-newChunkSize]=commonChunk[i];
-
-			// send back part of data
-			MPI_Send(newChunk, newChunkSize, MPI_INT, processID-1, globalIterator+2*maxIterations, MPI_COMM_WORLD);
-			printf("process %d has sent to process %d the chunk: ", processID, processID-1);
-			printVector(newChunk, newChunkSize); printf("\n");
-
-			// free memory
-			free(newChunk);
-			free(commonChunk);
+		// nobody to talk to in this iteration (but the round still has to be counted below)
+		else
+			partner=MPI_PROC_NULL;
+
+		// an empty chunk has no boundary and nothing to give or take: both partners know it, and skip the whole exchange
+		if (partner!=MPI_PROC_NULL && chunkSize>0 && partnerSize>0){
+
+			// first the partners swap just their boundary keys: the lower part its biggest element, the upper part its smallest one
+			myBoundary=(processID<partner) ? chunk[chunkSize-1] : chunk[0];
+			MPI_Sendrecv(&myBoundary, 1, ELEMENT_MPI_TYPE, partner, globalIterator,
+					&partnerBoundary, 1, ELEMENT_MPI_TYPE, partner, globalIterator, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+			// only the elements beyond the partner's boundary can cross it (binary search):
+			// the lower part sends its suffix bigger than the upper's smallest, the upper part its prefix smaller than the lower's biggest.
+			// The two counts are both zero when the chunks are already in order, and then the exchange is skipped
+			if (processID<partner){
+				sendStart=upperBound(chunk, chunkSize, partnerBoundary);
+				sendCount=chunkSize-sendStart;
+			}
+			else {
+				sendStart=0;
+				sendCount=lowerBound(chunk, chunkSize, partnerBoundary);
+			}
+			chunkElements+=chunkSize;
+
+			if (sendCount>0){
+				MPI_Sendrecv(chunk+sendStart, sendCount, ELEMENT_MPI_TYPE, partner, globalIterator,
+						newChunk, maxChunkSize, ELEMENT_MPI_TYPE, partner, globalIterator, MPI_COMM_WORLD, &status);
+				MPI_Get_count(&status, ELEMENT_MPI_TYPE, &newChunkSize);
+				elementsSent+=sendCount;
+
+				printf("process %d has received from process %d the elements: ", processID, partner);
+				printVector(newChunk, newChunkSize); printf("\n");
+
+				// the rest of the chunk stays where it is: just the part that was sent is merged with what arrived
+				// the lower part keeps the smallest elements, the upper part the biggest ones
+				memcpy(mergedChunk, chunk+sendStart, sizeof(Element)*sendCount);
+				if (processID<partner)
+					mergeLow(mergedChunk, sendCount, newChunk, newChunkSize, chunk+sendStart, sendCount);
+				else
+					mergeHigh(mergedChunk, sendCount, newChunk, newChunkSize, chunk, sendCount);
+				changed=1;
+
+				printf("process %d has kept the chunk: ", processID);
+				printVector(chunk, chunkSize); printf("\n");
+			}
 		}
 
+		// EARLY TERMINATION: a round checks just every other boundary (odd or even pairs),
+		// so the data is sorted when two rounds in a row have changed nothing anywhere
+		MPI_Allreduce(&changed, &anyChanged, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+		quietRounds=(anyChanged) ? 0 : quietRounds+1;
+		if (quietRounds==2)
+			break;
+	}
+
+	free(newChunk);
+	free(mergedChunk);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime=MPI_Wtime();
+	if (processID==MASTER)
+		printf("sorting time with %d processes: %f s\n", numberOfProcesses, endTime-startTime);
+	if (processID==MASTER)
+		printf("exchange rounds: %d of %d (%d saved)\n", rounds, maxIterations, maxIterations-rounds);
+
+	// how many elements have been moved, against the whole chunks that a plain exchange would have sent
+	MPI_Reduce(&elementsSent, &totalElementsSent, 1, MPI_LONG_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+	MPI_Reduce(&chunkElements, &totalChunkElements, 1, MPI_LONG_LONG, MPI_SUM, MASTER, MPI_COMM_WORLD);
+	if (processID==MASTER && totalChunkElements>0)
+		printf("exchanged elements: %lld of %lld (%.1f%%)\n", totalElementsSent, totalChunkElements, 100.0*totalElementsSent/totalChunkElements);
+
 
 	// END OF COMPUTATION; NOW NODE 0 HAS THE FIRST SORTED CHUNK, NODE 1 THE SECOND, AND SO ON
 
-	// so each slave sends his chunk to the master
-	if (processID>MASTER){
+	// PARALLEL I/O: each node writes its own part in the output file, where it read its input
+	if (PARALLEL_IO){
+		printf("process %d final data: ", processID);
+		printVector(chunk, chunkSize); printf("\n");
+		writeChunkParallel(outputFile, chunk, chunkSize, chunkOffset, totalNumberOfElements);
+	}
+
+	// otherwise each slave sends his chunk to the master
+	else if (processID>MASTER){
 		MPI_Send(&chunkSize, 1, MPI_INT, MASTER, 3*maxIterations+50, MPI_COMM_WORLD);
-		MPI_Send(chunk, chunkSize, MPI_INT, MASTER, 3*maxIterations+51, MPI_COMM_WORLD);
+		MPI_Send(chunk, chunkSize, ELEMENT_MPI_TYPE, MASTER, 3*maxIterations+51, MPI_COMM_WORLD);
 	}
 
 	// while the master will write the result in the output file
@@ -189,21 +293,20 @@ int main (int argc, char** argv){
 		FILE *outputFilePtr=fopen(outputFile, "wb");
 
 		if (outputFilePtr!=NULL){
-			int newChunkSize, it, jt; int* newChunk;
+			int newChunkSize, it; Element* newChunk=NULL;
 
 			// write master's part first
 			printf("master's final data: ");
 			printVector(chunk, chunkSize); printf("\n");
-			for (jt=0; jt<chunkSize; jt++)
-				fwrite(&chunk[jt], 1, sizeof(int), outputFilePtr);
+			fwrite(chunk, sizeof(Element), chunkSize, outputFilePtr);
 
 			// for each slave
 			for (it=1; it<numberOfProcesses; it++){
 
 				// receive data from it
 				MPI_Recv(&newChunkSize, 1, MPI_INT, it, 3*maxIterations+50, MPI_COMM_WORLD, NULL);
-				newChunk=(int*)malloc(newChunkSize*sizeof(int));
-				MPI_Recv(newChunk, newChunkSize, MPI_INT, it, 3*maxIterations+51, MPI_COMM_WORLD, NULL);
+				newChunk=(Element*)realloc(newChunk, newChunkSize*sizeof(Element));
+				MPI_Recv(newChunk, newChunkSize, ELEMENT_MPI_TYPE, it, 3*maxIterations+51, MPI_COMM_WORLD, NULL);
 
 				printf("master has received final data from process %d: ", it);
 
@@ -211,8 +314,7 @@ int main (int argc, char** argv){
 				printVector(newChunk, newChunkSize); printf("\n");
 
 				// write it into the output file
-				for (jt=0; jt<newChunkSize; jt++)
-					fwrite(&newChunk[jt], 1, sizeof(int), outputFilePtr);
+				fwrite(newChunk, sizeof(Element), newChunkSize, outputFilePtr);
 			}
 
 			free (newChunk);
@@ -226,45 +328,3 @@ int main (int argc, char** argv){
 	MPI_Finalize();
 	return 0;
 }
-
-
-// SIMPLE SORTING FUNCTION (BUBBLE SORT)
-void sort (int* vector, int size){
-	int i, j, tmp;
-	for (i = 0 ; i < size-1; i++)
-		for (j = 0 ; j<size-1; j++)
-			if (vector[j] > vector[j+1]){
-				tmp=vector[j];
-				vector[j]=vector[j+1];
-				vector[j+1]=tmp;
-			}
-}
-
-// auxiliary functions, just for testing purpose
-// generates n random numbers between 0 and 2n, writes them in the input file and prints them too
-void fillInputFile(char* file, int n){
-	FILE *fp=fopen(file, "wb");
-	if (fp!=NULL){
-		int i, r;
-		fwrite(&n, sizeof(int), 1, fp);
-		printf("vector = [");
-		for (i=0; i<n-1; i++){
-			r = rand()%(n*2);
-			fwrite(&r, sizeof(int), 1, fp);
-			printf("%d, ", r);
-		}
-		r = rand()%(n*2);
-		fwrite(&r, sizeof(int), 1, fp);
-		printf("%d]", r);
-		fclose(fp);
-	}
-}
-
-// prints a vector
-void printVector(int* vector, int n){
-	int i;
-	printf("[");
-	for (i=0; i<n-1; i++)
-		printf("%d, ", vector[i]);
-	printf("%d]", vector[n-1]);
-}
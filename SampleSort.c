@@ -0,0 +1,159 @@
+/*
+ * Implementation of distributed sample sort (parallel sorting by regular sampling)
+ *
+ * FILE STRUCTURE:
+ * first line= integer representing the number of elements
+ * other lines= an element to be sorted for each line (an int by default, see SortElement.h)
+ * (the output file contains just the sorted elements, like the ones of BitonicSort.c and OddEvenSort.c)
+ *
+ * PROCEDURE:
+ * Each node reads a portion (chunk) of data from the input file and sorts it
+ * Each node picks p regular samples from its sorted chunk (positions 0, n/p^2, 2n/p^2, ...)
+ * and the master gathers and sorts all of them, choosing p-1 splitters at regular positions
+ * The splitters divide each chunk in p buckets: bucket k is sent to node k with a single MPI_Alltoallv,
+ * so each element crosses the network about once
+ * Finally each node sorts what it received and writes it in the output file, right after the buckets of the nodes before it
+ *
+ * The load imbalance (biggest bucket over the average one) is printed by the master
+ *
+ * ASSUMPTION:
+ *  - shared file-system: each node reads and writes its own part of the files with MPI-IO
+ *  - a node can handle 2 chunks of data in memory (its own and the one it receives)
+ *    (for inputs bigger than the memory of the nodes see ExternalSort.c)
+ *
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "LocalSort.h"
+#include "SortIO.h"
+
+#define MASTER 0
+#define inputFile "../data/input.bin"
+#define outputFile "../data/output.bin"
+
+// number of random elements written in the input file (override with -DNUMBER_OF_ELEMENTS=...)
+#ifndef NUMBER_OF_ELEMENTS
+#define NUMBER_OF_ELEMENTS 15
+#endif
+
+int main (int argc, char** argv){
+
+	// common local variable declaration
+	int processID, numberOfProcesses, chunkSize, totalNumberOfElements;
+	Element *chunk;
+	MPI_Offset chunkOffset;
+	double startTime, endTime;
+
+	// init mpi environment
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+
+	// write something in the input file
+	if (processID==MASTER){
+		fillInputFile(inputFile, NUMBER_OF_ELEMENTS);
+	}
+
+	// the input file must be complete before anybody opens it
+	MPI_Barrier(MPI_COMM_WORLD);
+	chunk=readChunkParallel(inputFile, processID, numberOfProcesses, &totalNumberOfElements, &chunkSize, &chunkOffset);
+
+	// test prints
+	printf ("process %d has read the vector: ", processID);
+	printVector(chunk, chunkSize);
+	printf("\n");
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime=MPI_Wtime();
+
+	// NOW EACH NODE HAS ITS OWN CHUNK.
+	// BEGIN OF THE COMMON PARALLEL WORK: LOCAL SORT AND REGULAR SAMPLING
+	localSort(chunk, chunkSize);
+
+	int i;
+	Element samples[numberOfProcesses], splitters[numberOfProcesses];
+	Element *allSamples=NULL;
+
+	// an empty chunk has nothing to say about the splitters
+	for (i=0; i<numberOfProcesses; i++)
+		samples[i]=(chunkSize>0) ? chunk[(long)i*chunkSize/numberOfProcesses] : makeElement(KEY_MAX);
+
+	if (processID==MASTER)
+		allSamples=(Element*)malloc(sizeof(Element)*numberOfProcesses*numberOfProcesses);
+	MPI_Gather(samples, numberOfProcesses, ELEMENT_MPI_TYPE, allSamples, numberOfProcesses, ELEMENT_MPI_TYPE, MASTER, MPI_COMM_WORLD);
+
+	// the master chooses the splitters, in the middle of each group of p samples
+	if (processID==MASTER){
+		localSort(allSamples, numberOfProcesses*numberOfProcesses);
+		for (i=1; i<numberOfProcesses; i++)
+			splitters[i-1]=allSamples[i*numberOfProcesses+numberOfProcesses/2-1];
+		free(allSamples);
+
+		printf("splitters: ");
+		printVector(splitters, numberOfProcesses-1); printf("\n");
+	}
+	MPI_Bcast(splitters, numberOfProcesses-1, ELEMENT_MPI_TYPE, MASTER, MPI_COMM_WORLD);
+
+
+	// REDISTRIBUTION: bucket k (elements in (splitter k-1, splitter k]) goes to node k
+	int sendCounts[numberOfProcesses], sendOffsets[numberOfProcesses];
+	int receiveCounts[numberOfProcesses], receiveOffsets[numberOfProcesses];
+	int bucketEnd, newChunkSize;
+
+	// the chunk is sorted, so each bucket is a contiguous slice of it
+	sendOffsets[0]=0;
+	for (i=0; i<numberOfProcesses; i++){
+		bucketEnd=(i<numberOfProcesses-1) ? upperBound(chunk, chunkSize, splitters[i]) : chunkSize;
+		sendCounts[i]=bucketEnd-sendOffsets[i];
+		if (i<numberOfProcesses-1)
+			sendOffsets[i+1]=bucketEnd;
+	}
+
+	// everybody tells everybody else how much it is going to send
+	MPI_Alltoall(sendCounts, 1, MPI_INT, receiveCounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+	newChunkSize=0;
+	for (i=0; i<numberOfProcesses; i++){
+		receiveOffsets[i]=newChunkSize;
+		newChunkSize+=receiveCounts[i];
+	}
+
+	Element *newChunk=(Element*)malloc(sizeof(Element)*(newChunkSize>0 ? newChunkSize : 1));
+	MPI_Alltoallv(chunk, sendCounts, sendOffsets, ELEMENT_MPI_TYPE, newChunk, receiveCounts, receiveOffsets, ELEMENT_MPI_TYPE, MPI_COMM_WORLD);
+	free(chunk);
+
+	// what arrived is made of p sorted runs
+	localSort(newChunk, newChunkSize);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime=MPI_Wtime();
+	if (processID==MASTER)
+		printf("sorting time with %d processes: %f s\n", numberOfProcesses, endTime-startTime);
+
+
+	// LOAD IMBALANCE: biggest bucket over the average one (1 = perfect balance)
+	int biggestBucket;
+	MPI_Reduce(&newChunkSize, &biggestBucket, 1, MPI_INT, MPI_MAX, MASTER, MPI_COMM_WORLD);
+	if (processID==MASTER && totalNumberOfElements>0)
+		printf("load imbalance: biggest bucket %d elements, average %.1f, ratio %.3f\n", biggestBucket,
+				(double)totalNumberOfElements/numberOfProcesses, (double)biggestBucket*numberOfProcesses/totalNumberOfElements);
+
+
+	// END OF COMPUTATION; NOW NODE 0 HAS THE FIRST SORTED CHUNK, NODE 1 THE SECOND, AND SO ON
+	// each node writes it right after the chunks of the nodes before it
+	int position=0;
+	MPI_Exscan(&newChunkSize, &position, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+	if (processID==MASTER)
+		position=0;
+
+	printf("process %d final data: ", processID);
+	printVector(newChunk, newChunkSize); printf("\n");
+	writeChunkParallel(outputFile, newChunk, newChunkSize, position, totalNumberOfElements);
+
+	free(newChunk);
+	MPI_Finalize();
+	return 0;
+}
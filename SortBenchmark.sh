@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Benchmark of the distributed bitonic sort against the distributed odd-even sort and sample sort
+#
+# USAGE: ./SortBenchmark.sh [numberOfElements] [listOfProcesses]
+# default: 1048576 elements on 2, 4, 8 and 16 processes
+#
+# All the programs are compiled with the same NUMBER_OF_ELEMENTS, so they sort the same random input
+# (written by the master in ../data/input.bin), and print the time spent in the sorting phase only.
+# Before that, each program sorts SMALL_INPUT elements on SMALL_INPUT+1 processes (some of them get no elements at all),
+# both with parallel I/O and with the master doing the I/O (-DPARALLEL_IO=0): each run must end within a minute,
+# with the sorted input in the output file (and nothing else).
+# Everything runs in a temporary directory, which is removed at the end.
+#
+
+NUMBER_OF_ELEMENTS=${1:-1048576}
+PROCESSES=${2:-"2 4 8 16"}
+SMALL_INPUT=3
+SOURCES=$(cd "$(dirname "$0")" && pwd)
+WORKDIR=$(mktemp -d)
+
+mkdir -p "$WORKDIR/data" "$WORKDIR/run"
+
+for program in BitonicSort OddEvenSort SampleSort; do
+	mpicc -O2 -march=native -DNUMBER_OF_ELEMENTS="$NUMBER_OF_ELEMENTS" -o "$WORKDIR/$program" "$SOURCES/$program.c" -lm || exit 1
+done
+
+cd "$WORKDIR/run" || exit 1
+for program in BitonicSort OddEvenSort SampleSort; do
+	for parallelIO in 1 0; do
+		mpicc -O2 -DNUMBER_OF_ELEMENTS="$SMALL_INPUT" -DPARALLEL_IO="$parallelIO" -o "$WORKDIR/small" "$SOURCES/$program.c" -lm || exit 1
+		rm -f ../data/output.bin
+		printf "%-12s %d elements on %d processes, PARALLEL_IO=%d: " "$program" "$SMALL_INPUT" $((SMALL_INPUT+1)) "$parallelIO"
+		if timeout 60 mpirun --oversubscribe -np $((SMALL_INPUT+1)) ../small > /dev/null &&
+				[ "$(wc -c < ../data/output.bin)" -eq $((4*SMALL_INPUT)) ] &&
+				[ "$(od -An -v -td4 -j4 ../data/input.bin | tr -s ' ' '\n' | grep . | sort -n)" = \
+				"$(od -An -v -td4 ../data/output.bin | tr -s ' ' '\n' | grep .)" ]; then
+			echo "ok"
+		else
+			echo "FAILED"
+		fi
+	done
+done
+
+echo "sorting $NUMBER_OF_ELEMENTS elements"
+for processes in $PROCESSES; do
+	for program in BitonicSort OddEvenSort SampleSort; do
+		printf "%-12s " "$program"
+		mpirun --oversubscribe -np "$processes" "../$program" | grep "sorting time"
+	done
+done
+
+rm -rf "$WORKDIR"
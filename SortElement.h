@@ -0,0 +1,131 @@
+/*
+ * Element type of the distributed sorts, chosen at compile time with -DELEMENT_TYPE=...
+ *
+ *  INT_ELEMENTS (default) = int keys
+ *  LONG_ELEMENTS          = 64-bit keys
+ *  DOUBLE_ELEMENTS        = double keys
+ *  RECORD_ELEMENTS        = 64-bit key followed by PAYLOAD_SIZE bytes of payload (-DPAYLOAD_SIZE=..., default 8),
+ *                           sorted by key and moved as a whole, so no permutation pass is needed afterwards
+ *
+ * Each type defines:
+ *  Element, ElementKey  = the C types of an element and of its key
+ *  ELEMENT_KEY(e)       = the key of an element
+ *  ELEMENT_LESS(a, b)   = the order of the elements (by key; records with key KEY_MAX come before the sentinel, see below)
+ *  ELEMENT_MPI_TYPE     = the matching MPI datatype
+ *  KEY_MAX              = a key bigger than (or equal to) any other, for the sentinels (makeElement(KEY_MAX))
+ *  KEY_FORMAT           = how printf prints a key
+ *  makeElement(key)     = builds an element (a record carries a copy of its key in the payload, as a check)
+ *
+ * Files of elements keep the same structure: an int with the number of elements, then the elements
+ *
+ */
+
+#ifndef SORT_ELEMENT_H
+#define SORT_ELEMENT_H
+
+#include <mpi.h>
+#include <limits.h>
+#include <float.h>
+#include <string.h>
+
+#define INT_ELEMENTS 0
+#define LONG_ELEMENTS 1
+#define DOUBLE_ELEMENTS 2
+#define RECORD_ELEMENTS 3
+
+#ifndef ELEMENT_TYPE
+#define ELEMENT_TYPE INT_ELEMENTS
+#endif
+
+
+#if ELEMENT_TYPE==INT_ELEMENTS
+
+typedef int Element;
+typedef int ElementKey;
+#define ELEMENT_KEY(e) (e)
+#define ELEMENT_MPI_TYPE MPI_INT
+#define KEY_MAX INT_MAX
+#define KEY_FORMAT "%d"
+
+#elif ELEMENT_TYPE==LONG_ELEMENTS
+
+typedef long long Element;
+typedef long long ElementKey;
+#define ELEMENT_KEY(e) (e)
+#define ELEMENT_MPI_TYPE MPI_LONG_LONG
+#define KEY_MAX LLONG_MAX
+#define KEY_FORMAT "%lld"
+
+#elif ELEMENT_TYPE==DOUBLE_ELEMENTS
+
+typedef double Element;
+typedef double ElementKey;
+#define ELEMENT_KEY(e) (e)
+#define ELEMENT_MPI_TYPE MPI_DOUBLE
+#define KEY_MAX DBL_MAX
+#define KEY_FORMAT "%g"
+
+#elif ELEMENT_TYPE==RECORD_ELEMENTS
+
+#ifndef PAYLOAD_SIZE
+#define PAYLOAD_SIZE 8
+#endif
+
+typedef long long ElementKey;
+typedef struct
+{
+	ElementKey key;
+	char payload[PAYLOAD_SIZE];
+} Element;
+#define ELEMENT_KEY(e) ((e).key)
+#define ELEMENT_MPI_TYPE recordMPIType()
+#define KEY_MAX LLONG_MAX
+#define KEY_FORMAT "%lld"
+
+// A RECORD TRAVELS AS A BLOCK OF BYTES: THE DATATYPE IS BUILT THE FIRST TIME IT'S NEEDED
+static inline MPI_Datatype recordMPIType(void){
+	static MPI_Datatype recordType=MPI_DATATYPE_NULL;
+	if (recordType==MPI_DATATYPE_NULL){
+		MPI_Type_contiguous(sizeof(Element), MPI_BYTE, &recordType);
+		MPI_Type_commit(&recordType);
+	}
+	return recordType;
+}
+
+#else
+#error "unknown ELEMENT_TYPE"
+#endif
+
+#if ELEMENT_TYPE==RECORD_ELEMENTS
+#define ELEMENT_LESS(a, b) recordLess(a, b)
+#else
+#define ELEMENT_LESS(a, b) (ELEMENT_KEY(a)<ELEMENT_KEY(b))
+#endif
+
+
+// BUILDS AN ELEMENT WITH THE GIVEN KEY
+static inline Element makeElement(ElementKey key){
+	Element e;
+#if ELEMENT_TYPE==RECORD_ELEMENTS
+	memset(&e, 0, sizeof(Element));
+	e.key=key;
+	memcpy(e.payload, &key, (PAYLOAD_SIZE<sizeof(key)) ? PAYLOAD_SIZE : sizeof(key));
+#else
+	e=key;
+#endif
+	return e;
+}
+
+#if ELEMENT_TYPE==RECORD_ELEMENTS
+// THE ORDER OF THE RECORDS: BY KEY, AND THE SENTINEL AFTER ANY OTHER RECORD WITH KEY KEY_MAX
+// a sentinel is dropped by position (see BitonicSort.c), so a real record must never tie with it;
+// a record is taken for the sentinel only if its payload is the same too, and then either of them can be dropped
+static inline int recordLess(Element a, Element b){
+	if (a.key!=b.key || a.key!=KEY_MAX)
+		return a.key<b.key;
+	Element sentinel=makeElement(KEY_MAX);
+	return memcmp(a.payload, sentinel.payload, PAYLOAD_SIZE)!=0 && memcmp(b.payload, sentinel.payload, PAYLOAD_SIZE)==0;
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Files of the distributed sorts (BitonicSort.c, OddEvenSort.c, SampleSort.c, ExternalSort.c, MergeSort.c):
+ * an int with the number of elements, then the elements (see SortElement.h)
+ *
+ * balancedChunk(id, p, n, &size, &offset) splits n elements among p processes: the first n%p processes get one more
+ * openSortInputFile(path) opens the input file (collectively), or aborts if it can't
+ * readChunkParallel(path, id, p, &n, &size, &offset) reads the balanced chunk of a process from the input file (collectively)
+ * openSortOutputFile(path, n) opens the output file (collectively) and sets it to its final size
+ * writeChunkParallel(path, chunk, size, position, n) writes a chunk in the output file (collectively), from the position-th element
+ * fillInputFile(path, n) writes n random elements in the input file (just for test), printVector prints a vector
+ *
+ * NOTE: header only, so that each program is still compiled from its own single source file
+ *
+ */
+
+#ifndef SORT_IO_H
+#define SORT_IO_H
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SortElement.h"
+
+// longer vectors are printed as head and tail only (override with -DPRINT_LIMIT=...)
+#ifndef PRINT_LIMIT
+#define PRINT_LIMIT 20
+#endif
+
+// random elements generated in memory at a time by fillInputFile
+#define FILL_BLOCK 1048576
+
+// THE CHUNK OF PROCESS ID OUT OF P, WHEN N ELEMENTS ARE SPLIT AS EVENLY AS POSSIBLE: ITS SIZE AND ITS FIRST ELEMENT
+static inline void balancedChunk(int id, int p, int n, int* size, MPI_Offset* offset){
+	int result=n/p, rest=n%p;
+	*size=result+((id<rest) ? 1 : 0);
+	*offset=(MPI_Offset)id*result+((id<rest) ? id : rest);
+}
+
+// OPENS THE INPUT FILE (COLLECTIVELY), OR ABORTS: nobody can go on without the input
+static inline MPI_File openSortInputFile(const char* path){
+	MPI_File inputFileHandle;
+	int rank;
+
+	if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &inputFileHandle)!=MPI_SUCCESS){
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		if (rank==0)
+			printf("Error while opening the input file %s\n", path);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+	return inputFileHandle;
+}
+
+// EACH PROCESS READS ITS OWN BALANCED CHUNK OF THE INPUT FILE (COLLECTIVELY)
+// a process with a negative id is left out of the split (like the master of MergeSort.c): it reads an empty chunk
+static inline Element* readChunkParallel(const char* path, int id, int p, int* totalNumberOfElements, int* chunkSize, MPI_Offset* chunkOffset){
+	MPI_File inputFileHandle=openSortInputFile(path);
+	Element *chunk;
+
+	// everybody reads the number of elements, then computes its part
+	MPI_File_read_at_all(inputFileHandle, 0, totalNumberOfElements, 1, MPI_INT, MPI_STATUS_IGNORE);
+	*chunkSize=0;
+	*chunkOffset=0;
+	if (id>=0)
+		balancedChunk(id, p, *totalNumberOfElements, chunkSize, chunkOffset);
+
+	chunk=(Element*)malloc(sizeof(Element)*(*chunkSize>0 ? *chunkSize : 1));
+	MPI_File_read_at_all(inputFileHandle, sizeof(int)+*chunkOffset*sizeof(Element), chunk, *chunkSize, ELEMENT_MPI_TYPE, MPI_STATUS_IGNORE);
+	MPI_File_close(&inputFileHandle);
+
+	return chunk;
+}
+
+// OPENS THE OUTPUT FILE OF N ELEMENTS (COLLECTIVELY)
+// the size drops what an older (and longer) output file left there
+static inline MPI_File openSortOutputFile(const char* path, int totalNumberOfElements){
+	MPI_File outputFileHandle;
+
+	MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_WRONLY|MPI_MODE_CREATE, MPI_INFO_NULL, &outputFileHandle);
+	MPI_File_set_size(outputFileHandle, (MPI_Offset)totalNumberOfElements*sizeof(Element));
+	return outputFileHandle;
+}
+
+// EACH PROCESS WRITES SIZE ELEMENTS IN THE OUTPUT FILE (COLLECTIVELY), STARTING FROM THE POSITION-TH ONE
+static inline void writeChunkParallel(const char* path, const Element* chunk, int size, MPI_Offset position, int totalNumberOfElements){
+	MPI_File outputFileHandle=openSortOutputFile(path, totalNumberOfElements);
+
+	MPI_File_write_at_all(outputFileHandle, position*sizeof(Element), chunk, size, ELEMENT_MPI_TYPE, MPI_STATUS_IGNORE);
+	MPI_File_close(&outputFileHandle);
+}
+
+// prints a vector (just its head and its tail if it's longer than PRINT_LIMIT)
+static inline void printVector(const Element* vector, int n){
+	int i;
+	printf("[");
+	for (i=0; i<n; i++){
+		if (n>PRINT_LIMIT && i==PRINT_LIMIT/2){
+			printf("..., ");
+			i=n-PRINT_LIMIT/2;
+		}
+		printf((i<n-1) ? KEY_FORMAT ", " : KEY_FORMAT, ELEMENT_KEY(vector[i]));
+	}
+	printf("]");
+}
+
+// auxiliary function, just for testing purpose
+// generates n random numbers between 0 and 2n and writes them in the input file, FILL_BLOCK at a time
+// (and prints them too, when they fit in a single block)
+static inline void fillInputFile(const char* path, int n){
+	FILE *fp=fopen(path, "wb");
+	if (fp!=NULL){
+		int i, done, length;
+		Element *r=(Element*)malloc(sizeof(Element)*FILL_BLOCK);
+		fwrite(&n, sizeof(int), 1, fp);
+		for (done=0; done<n; done+=length){
+			length=(n-done<FILL_BLOCK) ? n-done : FILL_BLOCK;
+			for (i=0; i<length; i++)
+				r[i] = makeElement(rand()%(n*2));
+			fwrite(r, sizeof(Element), length, fp);
+		}
+		if (n<=FILL_BLOCK){
+			printf("vector = ");
+			printVector(r, n);
+			printf("\n");
+		}
+		else
+			printf("input file with %d random elements written\n", n);
+		free(r);
+		fclose(fp);
+	}
+}
+
+#endif
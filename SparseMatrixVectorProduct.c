@@ -0,0 +1,255 @@
+/*
+ * Read from a binary file k vectors X(dim n*1) and a sparse matrix A(dim n*n, CSR format)
+ * and compute X*A*X(transp) for each of them (optionally, also the products Y=A*X(transp)), like MatrixVectorProduct.c does for a dense A
+ *
+ * USAGE: SparseMatrixVectorProduct [-y outputFile] csrFile
+ *  -y = write the k products A*x in outputFile too, one after another (k vectors of n doubles, no header)
+ * (a dense input file of MatrixVectorProduct.c is converted by DenseToCSR.c)
+ *
+ * csrFile's structure:
+ * int = the size n
+ * int = the number of vectors k
+ * long long = the number of nonzeros nnz of A
+ * k*n doubles = the vectors x, one after another
+ * n+1 long long = the row pointers: the nonzeros of row i are the ones from rowPointers[i] to rowPointers[i+1]-1
+ * nnz int = the column of each nonzero, row by row
+ * nnz doubles = the value of each nonzero, in the same order
+ *
+ * PROCEDURE:
+ * Everybody reads the row pointers and divides the rows in contiguous blocks of about the same work, one per process:
+ * the work of a row is its number of nonzeros plus one (so that a block of many empty rows isn't free), so a few dense rows
+ * don't make a process much slower than the others, like an equal number of rows would.
+ * Each process reads the columns and the values of its block, and then just the entries of the vectors it needs
+ * (the columns its nonzeros refer to, and its own rows for the weights), with a single read through an indexed file view:
+ * the columns are renumbered to the position of their entry among the ones read
+ * Then it computes its rows of the products (see sparseMatrixVectorRows in MatrixKernel.h), weights row i by x[i],
+ * and finally the partial results are summed on the master
+ *
+ * ASSUMPTION:
+ *  - shared file-system: each process reads its own part of A and of the vectors (and writes its part of the products) with MPI-IO
+ *  - the row pointers fit in memory, and so does the part of A of a process
+ *
+ * HYBRID MPI+THREADS: compiled with -fopenmp, each process computes its rows with OMP_NUM_THREADS threads
+ * (only the master thread calls MPI: MPI_THREAD_FUNNELED)
+ *
+ */
+
+#include <stdio.h>
+#include <mpi.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "MatrixKernel.h"
+#include "MatrixIO.h"
+
+#define MASTER 0
+
+// size of the header of the csr file: n, k and nnz
+#define CSR_HEADER (2*sizeof(int)+sizeof(long long))
+
+int balancedStart(int, int, long long*, int);
+int compareInt(const void*, const void*);
+int findInt(int*, int, int);
+
+int main(int argc, char **argv){
+
+	// common variable declaration
+	int processID, numberOfProcesses, sizeA, numberOfVectors, threadSupport, option, i, j;
+	long long nonzeros;
+	char *outputFile=NULL;
+	double startTime, endTime;
+	MPI_File inputFile;
+
+	// init MPI's environment: the threads never call MPI, only the master thread does
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
+	MPI_Comm_rank(MPI_COMM_WORLD, &processID);
+	MPI_Comm_size(MPI_COMM_WORLD, &numberOfProcesses);
+	if (processID==MASTER && threadSupport<MPI_THREAD_FUNNELED && kernelThreads()>1)
+		printf("Warning: the MPI library does not support MPI_THREAD_FUNNELED\n");
+
+	while ((option=getopt(argc, argv, "y:"))!=-1){
+		if (option=='y')
+			outputFile=optarg;
+		else
+			optind=argc+1;
+	}
+	if (optind!=argc-1){
+		if (processID==MASTER)
+			printf("usage: %s [-y outputFile] csrFile\n", argv[0]);
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+
+	if (MPI_File_open(MPI_COMM_WORLD, argv[optind], MPI_MODE_RDONLY, MPI_INFO_NULL, &inputFile)!=MPI_SUCCESS){
+		if (processID==MASTER)
+			printf("error while opening the file\n");
+		MPI_Abort(MPI_COMM_WORLD, 0);
+	}
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	startTime=MPI_Wtime();
+
+	// everybody reads the header and the row pointers
+	MPI_File_read_at_all(inputFile, 0, &sizeA, 1, MPI_INT, MPI_STATUS_IGNORE);
+	MPI_File_read_at_all(inputFile, sizeof(int), &numberOfVectors, 1, MPI_INT, MPI_STATUS_IGNORE);
+	MPI_File_read_at_all(inputFile, 2*sizeof(int), &nonzeros, 1, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+
+	MPI_Offset vectorsOffset=CSR_HEADER;
+	MPI_Offset pointersOffset=vectorsOffset+(MPI_Offset)numberOfVectors*sizeA*sizeof(double);
+	MPI_Offset columnsOffset=pointersOffset+((MPI_Offset)sizeA+1)*sizeof(long long);
+	MPI_Offset valuesOffset=columnsOffset+(MPI_Offset)nonzeros*sizeof(int);
+
+	long long *rowPointers=(long long*)malloc(sizeof(long long)*(sizeA+1));
+	MPI_File_read_at_all(inputFile, pointersOffset, rowPointers, sizeA+1, MPI_LONG_LONG, MPI_STATUS_IGNORE);
+
+
+	// ************************************************* THE BLOCK OF ROWS *************************************************
+
+	int startingRow=balancedStart(processID, numberOfProcesses, rowPointers, sizeA);
+	int rows=balancedStart(processID+1, numberOfProcesses, rowPointers, sizeA)-startingRow;
+	long long firstNonzero=rowPointers[startingRow];
+	int localNonzeros=(int)(rowPointers[startingRow+rows]-firstNonzero);
+
+	// the row pointers of the block, from its first nonzero
+	long long *localPointers=(long long*)malloc(sizeof(long long)*(rows+1));
+	for (i=0; i<=rows; i++)
+		localPointers[i]=rowPointers[startingRow+i]-firstNonzero;
+	free(rowPointers);
+
+	int *columns=(int*)malloc(sizeof(int)*(localNonzeros+1));
+	double *values=(double*)malloc(sizeof(double)*(localNonzeros+1));
+	MPI_File_read_at_all(inputFile, columnsOffset+firstNonzero*sizeof(int), columns, localNonzeros, MPI_INT, MPI_STATUS_IGNORE);
+	MPI_File_read_at_all(inputFile, valuesOffset+firstNonzero*sizeof(double), values, localNonzeros, MPI_DOUBLE, MPI_STATUS_IGNORE);
+
+
+	// ************************************************* THE ENTRIES OF THE VECTORS *************************************************
+
+	// the columns the nonzeros refer to and the own rows, sorted and without duplicates
+	int *needed=(int*)malloc(sizeof(int)*(localNonzeros+rows+1));
+	int numberOfNeeded=0;
+	for (i=0; i<localNonzeros; i++)
+		needed[i]=columns[i];
+	for (i=0; i<rows; i++)
+		needed[localNonzeros+i]=startingRow+i;
+	qsort(needed, localNonzeros+rows, sizeof(int), compareInt);
+	for (i=0; i<localNonzeros+rows; i++)
+		if (numberOfNeeded==0 || needed[i]!=needed[numberOfNeeded-1])
+			needed[numberOfNeeded++]=needed[i];
+
+	// the file view shows just those entries of each vector (vector by vector, so the displacements grow)
+	MPI_Aint *displacements=(MPI_Aint*)malloc(sizeof(MPI_Aint)*((long)numberOfVectors*numberOfNeeded+1));
+	MPI_Datatype view=MPI_DOUBLE;
+	for (j=0; j<numberOfVectors; j++)
+		for (i=0; i<numberOfNeeded; i++)
+			displacements[(long)j*numberOfNeeded+i]=((MPI_Aint)j*sizeA+needed[i])*sizeof(double);
+	if (numberOfNeeded>0){
+		MPI_Type_create_hindexed_block(numberOfVectors*numberOfNeeded, 1, displacements, MPI_DOUBLE, &view);
+		MPI_Type_commit(&view);
+	}
+
+	double *byVector=(double*)malloc(sizeof(double)*((long)numberOfVectors*numberOfNeeded+1));
+	MPI_File_set_view(inputFile, vectorsOffset, MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+
+	// NOTE: an independent read, not a collective one: the views of the processes overlap (they share columns),
+	// and the collective read of some MPI-IO implementations (Open MPI's OMPIO) drops part of the shared entries
+	MPI_File_read(inputFile, byVector, numberOfVectors*numberOfNeeded, MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&inputFile);
+	if (view!=MPI_DOUBLE)
+		MPI_Type_free(&view);
+	free(displacements);
+
+	// the k entries of each needed column side by side, so that a nonzero multiplies them together
+	double *vectorsX=(double*)malloc(sizeof(double)*((long)numberOfNeeded*numberOfVectors+1));
+	transpose(numberOfVectors, numberOfNeeded, byVector, vectorsX);
+	free(byVector);
+
+	// the columns of the nonzeros become positions among the needed entries
+	for (i=0; i<localNonzeros; i++)
+		columns[i]=findInt(needed, numberOfNeeded, columns[i]);
+
+
+	// ************************************************* PRODUCT *************************************************
+
+	double *products=(double*)malloc(sizeof(double)*((long)rows*numberOfVectors+1));
+	sparseMatrixVectorRows(rows, localPointers, columns, values, numberOfVectors, vectorsX, products);
+
+	// row i of the product A*x is weighted by x[i]
+	double *partialResults=(double*)calloc(numberOfVectors, sizeof(double));
+	double *results=(double*)malloc(sizeof(double)*numberOfVectors);
+	int weight;
+	for (i=0; i<rows; i++){
+		weight=findInt(needed, numberOfNeeded, startingRow+i);
+		for (j=0; j<numberOfVectors; j++)
+			partialResults[j]+=vectorsX[(long)weight*numberOfVectors+j]*products[(long)i*numberOfVectors+j];
+	}
+
+	printf("process %d has computed value %lf (rows %d-%d, %d nonzeros, %d entries of x)\n", processID, partialResults[0],
+			startingRow, startingRow+rows-1, localNonzeros, numberOfNeeded);
+
+	// final reduction for computing the results
+	MPI_Reduce(partialResults, results, numberOfVectors, MPI_DOUBLE, MPI_SUM, MASTER, MPI_COMM_WORLD);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	endTime=MPI_Wtime();
+
+
+	// LOAD IMBALANCE: biggest block over the average one (1 = perfect balance)
+	int biggestBlock;
+	MPI_Reduce(&localNonzeros, &biggestBlock, 1, MPI_INT, MPI_MAX, MASTER, MPI_COMM_WORLD);
+
+	if (processID==MASTER){
+		printf("computation time with %d processes and %d vectors (I/O included): %f s\n", numberOfProcesses, numberOfVectors, endTime-startTime);
+		if (nonzeros>0)
+			printf("load imbalance: biggest block %d nonzeros, average %.1f, ratio %.3f\n", biggestBlock,
+					(double)nonzeros/numberOfProcesses, (double)biggestBlock*numberOfProcesses/nonzeros);
+		if (numberOfVectors==1)
+			printf("the final result is: %.17g\n", results[0]);
+		else
+			for (j=0; j<numberOfVectors; j++)
+				printf("the final result of vector %d is: %.17g\n", j, results[j]);
+	}
+
+	if (outputFile!=NULL)
+		writeProducts(outputFile, products, sizeA, numberOfVectors, startingRow, rows);
+
+	// free memory
+	free(localPointers); free(columns); free(values); free(needed); free(vectorsX);
+	free(products); free(partialResults); free(results);
+
+	MPI_Finalize();
+
+	return 0;
+}
+
+
+// FIRST ROW OF THE BLOCK OF PROCESS ID: THE FIRST ROW WHOSE WORK BEFORE IT (NONZEROS PLUS ROWS) REACHES ID/PARTS OF THE TOTAL
+// (the blocks are contiguous, and part parts starts at n)
+int balancedStart(int id, int parts, long long* rowPointers, int n){
+	long long target=(rowPointers[n]+n)*id/parts;
+	int low=0, high=n, middle;
+
+	while (low<high){
+		middle=low+(high-low)/2;
+		if (rowPointers[middle]+middle<target)
+			low=middle+1;
+		else
+			high=middle;
+	}
+	return low;
+}
+
+int compareInt(const void* a, const void* b){
+	return (*(int*)a>*(int*)b)-(*(int*)a<*(int*)b);
+}
+
+// position of value in the sorted vector (where it is)
+int findInt(int* vector, int n, int value){
+	int low=0, high=n, middle;
+	while (low<high){
+		middle=low+(high-low)/2;
+		if (vector[middle]<value)
+			low=middle+1;
+		else
+			high=middle;
+	}
+	return low;
+}